@@ -3,10 +3,21 @@ LOCAL_PATH := $(call my-dir)
 # binary
 include $(CLEAR_VARS)
 LOCAL_MODULE := tinysu
-LOCAL_SRC_FILES := daemon/tinysu.cpp daemon/daemon.cpp daemon/client.cpp
+LOCAL_SRC_FILES := daemon/tinysu.cpp daemon/daemon.cpp daemon/client.cpp daemon/priority.cpp daemon/trace.cpp daemon/usage.cpp daemon/config.cpp daemon/record.cpp daemon/policy.cpp daemon/bench.cpp daemon/activate.cpp
 LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/daemon
-LOCAL_LDLIBS := -llog
+LOCAL_LDLIBS := -llog -lz
 LOCAL_CFLAGS := -DARM
 LOCAL_CPPFLAGS := -std=c++11
 include $(BUILD_EXECUTABLE)
+
+# fast-start client: su -c only, static and without liblog, for the least work between exec and connect
+include $(CLEAR_VARS)
+LOCAL_MODULE := tinysu_fast
+LOCAL_SRC_FILES := daemon/tinysu.cpp daemon/client.cpp daemon/config.cpp daemon/trace.cpp daemon/bench.cpp
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/daemon
+LOCAL_CFLAGS := -DARM -DFAST_START
+LOCAL_CPPFLAGS := -std=c++11
+LOCAL_LDFLAGS := -static
+include $(BUILD_EXECUTABLE)
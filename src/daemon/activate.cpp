@@ -0,0 +1,117 @@
+/*
+ * Socket activation: with -a we only bind the listening sockets and wait. On the first connection we start
+ * the real daemon (this binary with -d) and hand it both sockets through TINYSU_LISTEN_FDS, together with
+ * whatever is queued on them. The daemon exits once it has been without sessions for idle_exit seconds,
+ * and we go back to waiting. Nothing connects to a closed socket in between, the sockets are ours all along.
+ * SIGHUP sent to us is passed on to the daemon, if one is running.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+#include "tinysu.h"
+#include "activate.h"
+#include "daemon.h"
+#include "trace.h"
+
+volatile pid_t daemonPid = 0;
+char daemonPath[256];
+
+/**
+ * Pass SIGHUP on to the daemon, so that reloading works the same with or without -a
+ */
+void forwardHangup(int signum) {
+    if (daemonPid > 0) {
+        kill(daemonPid, SIGHUP);
+    }
+}
+
+/**
+ * Start the daemon on our sockets and wait until it is gone
+ */
+void runDaemon(int listenFd, int listenErrFd) {
+    char fds[32];
+    snprintf(fds, sizeof(fds), "%d,%d", listenFd, listenErrFd);
+    long long startTime = traceNow();
+
+    int pid = fork();
+    if (pid == 0) {
+        // the sockets must survive the exec
+        fcntl(listenFd, F_SETFD, 0);
+        fcntl(listenErrFd, F_SETFD, 0);
+        setenv(LISTEN_FDS_ENV, fds, 1);
+        // a SIGHUP we forward before the daemon has its handler must wait, not kill it.
+        // the mask survives exec, goDaemonMode() unblocks it
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGHUP);
+        sigprocmask(SIG_BLOCK, &mask, nullptr);
+        signal(SIGHUP, SIG_DFL);
+        execl(daemonPath, daemonPath, "-d", (char *) nullptr);
+        LogE(DAEMON, "Error exec daemon");
+        exit(1);
+    }
+    if (pid < 0) {
+        LogE(DAEMON, "Cannot fork daemon. Error %s", strerror(errno));
+        sleep(1);
+        return;
+    }
+    LogI(DAEMON, "Started daemon %d", pid);
+    daemonPid = pid;
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    daemonPid = 0;
+    LogI(DAEMON, "Daemon %d is gone after %lld s", pid, (traceNow() - startTime) / 1000000);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        // don't spin if it dies right away
+        sleep(1);
+    }
+}
+
+/**
+ * Hold the listening sockets and start the daemon whenever a client shows up
+ */
+void goActivateMode() {
+    LogI(DAEMON, "This is TinySU ver %s.", TINYSU_VER_STR);
+    LogI(DAEMON, "Operating in activation mode.");
+
+    // exec the daemon by its real path, so that it shows up under the same name as we do
+    ssize_t len = readlink("/proc/self/exe", daemonPath, sizeof(daemonPath) - 1);
+    daemonPath[len > 0 ? len : 0] = 0;
+    if (len <= 0 || access(daemonPath, X_OK) != 0) {
+        // deleted or replaced since we started
+        snprintf(daemonPath, sizeof(daemonPath), "/proc/self/exe");
+    }
+
+    struct sigaction act = {};
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = forwardHangup;
+    sigaction(SIGHUP, &act, nullptr);
+
+    mkdir("/su", 0777);
+    int listenFd = initListeningSocket(config.socketPath);
+    int listenErrFd = initListeningSocket(config.socketErrPath);
+
+    while (true) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(listenFd, &readSet);
+        int selectVal = select(listenFd + 1, &readSet, nullptr, nullptr, nullptr);
+        if (selectVal < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("select");
+            exit(1);
+        }
+        runDaemon(listenFd, listenErrFd);
+    }
+}
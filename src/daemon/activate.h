@@ -0,0 +1,5 @@
+#pragma once
+
+#define LISTEN_FDS_ENV (char*) "TINYSU_LISTEN_FDS"
+
+void goActivateMode();
@@ -0,0 +1,174 @@
+/*
+ * Startup benchmark: run this binary as "su -c echo tinysu" again and again and report how long each step takes.
+ * The client under test writes the time it got connected and the time it got its first byte to TINYSU_BENCH_FD,
+ * so we get exec -> connect -> first byte -> exit. The daemon must be running and must let us in.
+ * Run it from both the normal and the fast-start binary to compare them.
+ * With a budget "<connect_us>[,<first_us>]" it exits non-zero if the median exec -> connect or exec -> first byte
+ * goes over it, or if any run fails, so that it can gate changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "tinysu.h"
+#include "bench.h"
+#include "trace.h"
+
+/**
+ * One run. The times are relative to the fork, in microseconds.
+ * @return false if the client did not get through
+ */
+bool benchRun(long long *connectTime, long long *firstTime, long long *exitTime) {
+    int marks[2];
+    int out[2];
+    if (pipe(marks) < 0) {
+        return false;
+    }
+    if (pipe(out) < 0) {
+        close(marks[0]);
+        close(marks[1]);
+        return false;
+    }
+
+    long long startTime = traceNow();
+    int pid = fork();
+    if (pid == 0) {
+        // marks[0] may well be BENCH_FD, get rid of it first
+        close(out[0]);
+        close(marks[0]);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(marks[1], BENCH_FD);
+        char fd[16];
+        sprintf(fd, "%d", BENCH_FD);
+        setenv(BENCH_ENV, fd, 1);
+        execl("/proc/self/exe", "su", "-c", "echo", BENCH_WORD, (char *) nullptr);
+        exit(127);
+    }
+    close(out[1]);
+    close(marks[1]);
+    if (pid < 0) {
+        close(out[0]);
+        close(marks[0]);
+        return false;
+    }
+
+    // the output is a few bytes and the marks two short lines, the pipes hold both until we read them
+    char s[256];
+    memset(s, 0, sizeof(s));
+    int len = 0;
+    ssize_t numRead;
+    while (len < (int) sizeof(s) - 1 && (numRead = read(marks[0], s + len, sizeof(s) - 1 - len)) > 0) {
+        len += numRead;
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    *exitTime = traceNow() - startTime;
+
+    char output[256];
+    memset(output, 0, sizeof(output));
+    read(out[0], output, sizeof(output) - 1);
+    close(out[0]);
+    close(marks[0]);
+
+    long long connected = 0;
+    long long first = 0;
+    char *line = strstr(s, "connect ");
+    if (line) {
+        connected = atoll(line + 8);
+    }
+    line = strstr(s, "first ");
+    if (line) {
+        first = atoll(line + 6);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !connected || !first || !strstr(output, BENCH_WORD)) {
+        return false;
+    }
+    *connectTime = connected - startTime;
+    *firstTime = first - startTime;
+    return true;
+}
+
+int compareTimes(const void *a, const void *b) {
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Print min / median / p90 / max of one step
+ * @return the median
+ */
+long long printTimes(const char *name, long long *times, int count) {
+    qsort(times, (size_t) count, sizeof(long long), compareTimes);
+    printf("%-20s %8lld %8lld %8lld %8lld\n", name, times[0], times[count / 2], times[count * 9 / 10], times[count - 1]);
+    return times[count / 2];
+}
+
+/**
+ * Compare a median against its budget, 0 meaning no budget
+ */
+bool withinBudget(const char *name, long long median, long long budget) {
+    if (budget > 0 && median > budget) {
+        LogE(CLIENT, "Median %s is %lldus, over the budget of %lldus", name, median, budget);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Run the benchmark and print the results in microseconds
+ */
+void goBenchMode(int runs, char *budget) {
+    if (runs <= 0) {
+        runs = 1;
+    }
+    long long connectBudget = 0;
+    long long firstBudget = 0;
+    if (budget) {
+        sscanf(budget, "%lld,%lld", &connectBudget, &firstBudget);
+    }
+    long long *connectTimes = (long long *) calloc((size_t) runs, sizeof(long long));
+    long long *firstTimes = (long long *) calloc((size_t) runs, sizeof(long long));
+    long long *connectToFirst = (long long *) calloc((size_t) runs, sizeof(long long));
+    long long *exitTimes = (long long *) calloc((size_t) runs, sizeof(long long));
+    int count = 0;
+    int failed = 0;
+    bool passed = true;
+    for (int i = 0; i < runs; i++) {
+        if (benchRun(&connectTimes[count], &firstTimes[count], &exitTimes[count])) {
+            connectToFirst[count] = firstTimes[count] - connectTimes[count];
+            count++;
+        }
+        else {
+            failed++;
+        }
+    }
+
+    if (count > 0) {
+        printf("%d runs, %d failed, usec:\n", runs, failed);
+        printf("%-20s %8s %8s %8s %8s\n", "", "min", "median", "p90", "max");
+        long long connectMedian = printTimes("exec -> connect", connectTimes, count);
+        printTimes("connect -> 1st byte", connectToFirst, count);
+        long long firstMedian = printTimes("exec -> 1st byte", firstTimes, count);
+        printTimes("exec -> exit", exitTimes, count);
+        passed = withinBudget("exec -> connect", connectMedian, connectBudget) && passed;
+        passed = withinBudget("exec -> 1st byte", firstMedian, firstBudget) && passed;
+        if (budget && failed > 0) {
+            LogE(CLIENT, "%d runs failed", failed);
+            passed = false;
+        }
+    }
+    else {
+        LogE(CLIENT, "All %d runs failed. Is the daemon running and letting us in?", runs);
+        passed = false;
+    }
+    free(connectTimes);
+    free(firstTimes);
+    free(connectToFirst);
+    free(exitTimes);
+    exit(passed ? 0 : 1);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#define BENCH_FD 3
+#define BENCH_WORD (char*) "tinysu"
+
+void goBenchMode(int runs, char *budget);
@@ -8,19 +8,85 @@
 #include <string.h>
 #include <netinet/ip.h>
 #include <sys/un.h>
+#include <sys/ioctl.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <termios.h>
 
 #include "tinysu.h"
+#include "client.h"
+#include "trace.h"
 
 int clientId;
 int daemonFd;
 int daemonErrFd;
+struct termios savedTermios;
+int savedStdinFlags;
+volatile sig_atomic_t windowChanged = 0;
+
+/**
+ * Fill in the window size of our terminal
+ */
+void getWindowSize(request_t *req) {
+    struct winsize ws;
+    memset(&ws, 0, sizeof(ws));
+    ioctl(STDIN_FILENO, TIOCGWINSZ, &ws);
+    req->rows = ws.ws_row;
+    req->cols = ws.ws_col;
+}
+
+/**
+ * SIGWINCH handler. The actual forwarding happens in sendCommand()
+ */
+void handleWindowChange(int signum) {
+    windowChanged = 1;
+}
+
+/**
+ * Put our terminal into raw mode, the remote pty does all the line editing
+ */
+void enterTerminalMode() {
+    savedStdinFlags = fcntl(STDIN_FILENO, F_GETFL, 0);
+    tcgetattr(STDIN_FILENO, &savedTermios);
+    struct termios raw = savedTermios;
+    cfmakeraw(&raw);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+    // no SA_RESTART, we want select() to wake up
+    struct sigaction act = {};
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = handleWindowChange;
+    sigaction(SIGWINCH, &act, nullptr);
+}
+
+/**
+ * Give our terminal back the way we found it
+ */
+void restoreTerminal() {
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedTermios);
+    fcntl(STDIN_FILENO, F_SETFL, savedStdinFlags);
+}
+
+/**
+ * Tell the daemon about our new window size
+ */
+void sendWindowSize() {
+    char s[REQUEST_LEN];
+    request_t req;
+    getWindowSize(&req);
+    sprintf(s, "%c %d %d\n", WINDOW_CHANGE, req.rows, req.cols);
+    write(daemonErrFd, s, strlen(s));
+}
 
 /**
  * Connect to the daemon, both on regular port and stderr port
+ * @param req the session we ask for
  */
-void connectToDaemon() {
+void connectToDaemon(request_t *req) {
     char s[16];
     struct sockaddr_un saddr;
+    int session = getpid();
+    long long connectTime = traceNow();
 
     // create the socket
     if ((daemonFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
@@ -31,27 +97,49 @@ void connectToDaemon() {
     // init sockaddr
     memset(&saddr, 0, sizeof(saddr));
     saddr.sun_family = AF_UNIX;
-    strcpy(saddr.sun_path, TINYSU_SOCKET_PATH);
+    strcpy(saddr.sun_path, config.socketPath);
 
     // connect to server
     if (connect(daemonFd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0) {
-        LogE(CLIENT, "Cannot connect to daemon at %s. Error %s", TINYSU_SOCKET_PATH, strerror(errno));
+        LogE(CLIENT, "Cannot connect to daemon at %s. Error %s", config.socketPath, strerror(errno));
         doClose(daemonFd);
         exit(1);
     }
     LogV(CLIENT, "daemonFd=%d", daemonFd);
+    traceSpan("connect", session, connectTime);
+    traceBench("connect");
+
+    // tell what kind of session we want
+    char request[REQUEST_LEN];
+    if (showUsage) {
+        req->flags |= REQUEST_USAGE;
+    }
+    size_t commandLen = req->command ? strlen(req->command) : 0;
+    snprintf(request, sizeof(request), "%c %d %d %s %d %d\n", req->mode, req->rows, req->cols,
+             req->term[0] ? req->term : "-", req->flags, (int) commandLen);
+    write(daemonFd, request, strlen(request));
+    if (commandLen) {
+        write(daemonFd, req->command, commandLen);
+    }
 
     // wait for our id
+    long long authTime = traceNow();
     memset(s, 0, sizeof(s));
-    ssize_t numRead = read(daemonFd, s, sizeof(s));
-    if (numRead <= 0) {
+    ssize_t numRead = recv(daemonFd, s, sizeof(s) - 1, MSG_PEEK);
+    char *end = numRead > 0 ? strchr(s, '\n') : nullptr;
+    if (end == nullptr) {
         // we are not authenticated.
         LogE(DAEMON, "Not authenticated.");
         close(daemonFd);
         exit(1);
     }
+    // take the id line only, the output of the command may follow it
+    read(daemonFd, s, (size_t) (end - s + 1));
+    *end = 0;
     clientId = atoi(s);
     LogV(CLIENT, "Our id is %d", clientId);
+    traceSpan("wait auth", session, authTime);
+    long long errConnectTime = traceNow();
 
     // create the stderr socket
     if ((daemonErrFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
@@ -62,11 +150,11 @@ void connectToDaemon() {
     // init sockaddr
     memset(&saddr, 0, sizeof(saddr));
     saddr.sun_family = AF_UNIX;
-    strcpy(saddr.sun_path, TINYSU_SOCKET_ERR_PATH);
+    strcpy(saddr.sun_path, config.socketErrPath);
 
     // connect to server on stderr socket
     if (connect(daemonErrFd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0) {
-        LogE(CLIENT, "Cannot connect to daemon err at %s. Error %s", TINYSU_SOCKET_ERR_PATH, strerror(errno));
+        LogE(CLIENT, "Cannot connect to daemon err at %s. Error %s", config.socketErrPath, strerror(errno));
         perror("connect");
         doClose(daemonErrFd);
         exit(1);
@@ -76,25 +164,24 @@ void connectToDaemon() {
     // make them nonblocking
     markNonblock(daemonFd);
     markNonblock(daemonErrFd);
+    traceSpan("connect stderr", session, errConnectTime);
 
     LogV(CLIENT, "Connected successfully!");
 }
 
 /**
- * Send command to server and wait for response.
- * @param cmd command to send. if nullptr, get command from stdin
+ * Wait for the response of the server.
+ * @param cmd the command that went with the request. if nullptr, forward stdin
  */
 void sendCommand(int daemonFd, char *cmd) {
     fd_set readSet;
     struct timeval timeout = {};
     memset(&timeout, 0, sizeof(timeout));
+    int session = getpid();
+    bool gotOutput = false;
+    long long sendTime = traceNow();
 
-    if (cmd != nullptr) {
-        LogV(CLIENT, " - SendCommand: Sending command %s", cmd);
-        strcat(cmd, "\nexit\n");
-        write(daemonFd, cmd, strlen(cmd));
-    }
-    else {
+    if (cmd == nullptr) {
         // make stdin nonblocking
         markNonblock(STDIN_FILENO);
     }
@@ -111,7 +198,14 @@ void sendCommand(int daemonFd, char *cmd) {
         // pool and wait
         timeout.tv_sec = 3600;
         int selectVal = select(maxFd + 1, &readSet, nullptr, nullptr, &timeout);
+        if (windowChanged) {
+            windowChanged = 0;
+            sendWindowSize();
+        }
         if (selectVal < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             // error
             break;
         }
@@ -123,6 +217,11 @@ void sendCommand(int daemonFd, char *cmd) {
                 proxy(STDIN_FILENO, daemonFd, nothing);
             }
             // is that an incoming connection from the connected socket?
+            if (!gotOutput && (FD_ISSET(daemonFd, &readSet) || FD_ISSET(daemonErrFd, &readSet))) {
+                gotOutput = true;
+                traceInstant("first byte", session);
+                traceBench("first");
+            }
             if (FD_ISSET(daemonFd, &readSet)) {
                 // forward to stdout
                 proxy(daemonFd, STDOUT_FILENO, [&connected](int from) {
@@ -144,6 +243,7 @@ void sendCommand(int daemonFd, char *cmd) {
         }
     }
     fflush(stdout);
+    traceSpan("sendCommand", session, sendTime);
 }
 
 /**
@@ -151,26 +251,55 @@ void sendCommand(int daemonFd, char *cmd) {
  */
 void goCommandMode(int argc, char **argv) {
     LogI(CLIENT, "CommandMode: Going command mode. PPID=%d", getppid());
-    char cmd[ARG_LEN];
+    request_t req;
+    memset(&req, 0, sizeof(req));
+    req.mode = MODE_COMMAND;
 
     // concat argv
-    memset(cmd, 0, sizeof(cmd));
+    size_t len = 1;
+    for (int i = optind - 1; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char *cmd = (char *) calloc(len, 1);
     for (int i = optind - 1; i < argc; i++) {
         strcat(cmd, argv[i]);
         strcat(cmd, " ");
     }
-    connectToDaemon();
-    usleep(200*1000);
+    if (strlen(cmd) > COMMAND_MAX) {
+        LogE(CLIENT, "Command is too long.");
+        exit(1);
+    }
+    req.command = cmd;
+    connectToDaemon(&req);
     sendCommand(daemonFd, cmd);
     doClose(daemonFd);
+    free(cmd);
 }
 
 /**
- * Go to interactive mode
+ * Go to interactive mode. If we are on a terminal, ask the daemon for a pty as well
  */
 void goInteractiveMode() {
     LogI(CLIENT, "Interactive: Going interactive mode. PPID=%d", getppid());
-    connectToDaemon();
+    request_t req;
+    memset(&req, 0, sizeof(req));
+    req.mode = MODE_INTERACTIVE;
+    bool terminal = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+    if (terminal) {
+        req.mode = MODE_TERMINAL;
+        getWindowSize(&req);
+        char *term = getenv("TERM");
+        if (term) {
+            snprintf(req.term, sizeof(req.term), "%s", term);
+        }
+    }
+    connectToDaemon(&req);
+    if (terminal) {
+        enterTerminalMode();
+    }
     sendCommand(daemonFd, nullptr);
+    if (terminal) {
+        restoreTerminal();
+    }
     doClose(daemonFd);
 }
\ No newline at end of file
@@ -4,5 +4,7 @@
 
 #pragma once
 
+extern bool showUsage;
+
 void goCommandMode(int argc, char **argv);
 void goInteractiveMode();
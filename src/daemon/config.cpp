@@ -0,0 +1,93 @@
+/*
+ * Runtime configuration. The #defines in tinysu.h are the defaults, CONFIG_PATH can override them with
+ * "key=value" lines. The daemon reads it at startup and again on SIGHUP; socket paths only take effect
+ * at startup since the sockets are already bound.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "tinysu.h"
+#include "config.h"
+
+config_t config;
+
+/**
+ * Set an integer option, ignoring values below min
+ */
+void setInt(int *option, char *key, char *value, int min) {
+    int v = atoi(value);
+    if (v < min) {
+        LogE(DAEMON, "Ignoring %s=%s", key, value);
+        return;
+    }
+    *option = v;
+}
+
+/**
+ * Set a string option
+ */
+void setString(char *option, size_t len, char *value) {
+    snprintf(option, len, "%s", value);
+}
+
+/**
+ * Reset to defaults, then apply CONFIG_PATH if it exists
+ */
+void loadConfig() {
+    memset(&config, 0, sizeof(config));
+    setString(config.socketPath, sizeof(config.socketPath), TINYSU_SOCKET_PATH);
+    setString(config.socketErrPath, sizeof(config.socketErrPath), TINYSU_SOCKET_ERR_PATH);
+    setString(config.shell, sizeof(config.shell), DEFAULT_SHELL);
+    config.maxClient = MAX_CLIENT;
+    config.backlog = LISTEN_BACKLOG;
+    config.authTimeout = AUTH_TIMEOUT;
+    config.proxyLen = PROXY_LEN;
+    config.forwardLen = FORWARD_LEN;
+    config.coalesceUsec = COALESCE_USEC;
+    config.coalesceLen = COALESCE_LEN;
+    config.maxUidStats = MAX_UID_STATS;
+    setString(config.recordDir, sizeof(config.recordDir), RECORD_DIR);
+    config.recordMax = RECORD_MAX;
+    config.recordKeep = RECORD_KEEP;
+    config.idleExit = IDLE_EXIT;
+
+    FILE *file = fopen(CONFIG_PATH, "r");
+    if (!file) {
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = 0;
+        char *value = strchr(line, '=');
+        if (value == nullptr) {
+            continue;
+        }
+        *value++ = 0;
+        char *key = line;
+
+        if (strcmp(key, "socket") == 0) setString(config.socketPath, sizeof(config.socketPath), value);
+        else if (strcmp(key, "socket_err") == 0) setString(config.socketErrPath, sizeof(config.socketErrPath), value);
+        else if (strcmp(key, "shell") == 0) setString(config.shell, sizeof(config.shell), value);
+        else if (strcmp(key, "max_client") == 0) setInt(&config.maxClient, key, value, 1);
+        else if (strcmp(key, "backlog") == 0) setInt(&config.backlog, key, value, 1);
+        else if (strcmp(key, "auth_timeout") == 0) setInt(&config.authTimeout, key, value, 1);
+        else if (strcmp(key, "proxy_len") == 0) setInt(&config.proxyLen, key, value, 2);
+        else if (strcmp(key, "forward_len") == 0) setInt(&config.forwardLen, key, value, 1);
+        else if (strcmp(key, "coalesce_usec") == 0) setInt(&config.coalesceUsec, key, value, 0);
+        else if (strcmp(key, "coalesce_len") == 0) setInt(&config.coalesceLen, key, value, 1);
+        else if (strcmp(key, "max_uid_stats") == 0) setInt(&config.maxUidStats, key, value, 1);
+        else if (strcmp(key, "record_uids") == 0) setString(config.recordUids, sizeof(config.recordUids), value);
+        else if (strcmp(key, "record_dir") == 0) setString(config.recordDir, sizeof(config.recordDir), value);
+        else if (strcmp(key, "record_max") == 0) setInt(&config.recordMax, key, value, 1);
+        else if (strcmp(key, "record_keep") == 0) setInt(&config.recordKeep, key, value, 1);
+        else if (strcmp(key, "idle_exit") == 0) setInt(&config.idleExit, key, value, 0);
+        else LogE(DAEMON, "Unknown config key %s", key);
+    }
+    fclose(file);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#ifdef ARM
+    #define CONFIG_PATH (char*) "/su/tinysu.conf"
+#else
+    #define CONFIG_PATH (char*) "/tmp/tinysu.conf"
+#endif
+
+// struct definitions
+typedef struct config {
+    char socketPath[108];
+    char socketErrPath[108];
+    char shell[128];
+    int maxClient;
+    int backlog;
+    int authTimeout;
+    int proxyLen;
+    int forwardLen;
+    int coalesceUsec;
+    int coalesceLen;
+    int maxUidStats;
+    char recordUids[256];
+    char recordDir[108];
+    int recordMax;
+    int recordKeep;
+    int idleExit;
+} config_t;
+
+extern config_t config;
+
+void loadConfig();
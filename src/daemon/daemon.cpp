@@ -13,24 +13,49 @@
 #include <errno.h>
 #include <sys/un.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <dirent.h>
+#include <poll.h>
 
 #if defined(SO_PEERCRED)
 //#include <sys/ucred.h>
 #endif
 
 #include "tinysu.h"
+#include "priority.h"
+#include "trace.h"
+#include "usage.h"
+#include "record.h"
+#include "policy.h"
+#include "activate.h"
 
 int listenFd;
 int listenErrFd;
+int idleFdCount;
+bool activated = false;
+incoming_t incoming[INCOMING_MAX];
+int incomingUsed = 0;
+long long idleSince = 0;
+volatile sig_atomic_t reloadRequested = 0;
+volatile sig_atomic_t exitRequested = 0;
 
 /**
- * Signal handler. Mainly used to process SIGCHLD from children
+ * Signal handler. Mainly used to process SIGCHLD from children, SIGHUP to reload the config and SIGTERM to exit
  */
 void handleSignals(int signum, siginfo_t *info, void *ptr)  {
+    if (signum == SIGHUP) {
+        reloadRequested = 1;
+    }
+    if (signum == SIGTERM) {
+        exitRequested = 1;
+    }
     if (signum == SIGCHLD) {
-        for (int i = 0; i < MAX_CLIENT; i++) {
+        for (int i = 0; i < clientCount; i++) {
             if (clients[i].pid == info->si_pid) {
                 LogV(DAEMON, " - Child %d is killed. ", clients[i].pid);
+                clients[i].exitTime = traceNow();
                 clients[i].died = 1;
                 break;
             }
@@ -47,6 +72,8 @@ void registerSignalHandler() {
     act.sa_sigaction = handleSignals;
     act.sa_flags = SA_SIGINFO | SA_RESTART;
     sigaction(SIGCHLD, &act, nullptr);
+    sigaction(SIGHUP, &act, nullptr);
+    sigaction(SIGTERM, &act, nullptr);
     LogV(DAEMON, "Registered signal handler.");
 }
 
@@ -68,6 +95,7 @@ int initListeningSocket(char *path) {
 
     // make it nonblocking
     markNonblock(sockfd);
+    markCloexec(sockfd);
 
     memset(&saddr, 0, sizeof(saddr));
     saddr.sun_family = AF_UNIX;
@@ -80,21 +108,340 @@ int initListeningSocket(char *path) {
         exit(1);
     }
 
-    if (listen(sockfd, 5) < 0) {
+    if (listen(sockfd, config.backlog) < 0) {
         LogE(DAEMON, "Error listening to socket");
         exit(1);
     }
     return sockfd;
 }
 
+/**
+ * Write out whatever a terminal session has buffered.
+ * If the client socket is full, the rest stays buffered and outBlocked is set until the socket becomes writable.
+ */
+void flushTerminal(int clientIdx) {
+    client_t *c = &clients[clientIdx];
+    c->flushTime = 0;
+    while (c->pendingLen > 0) {
+        ssize_t numWritten = write(c->fd, c->pending, (size_t) c->pendingLen);
+        if (numWritten < 0 && errno == EAGAIN) {
+            c->outBlocked = true;
+            return;
+        }
+        if (numWritten <= 0) {
+            // the client is gone, nobody will read this
+            c->pendingLen = 0;
+            break;
+        }
+        c->bytes += numWritten;
+        if (c->recOut > 0) {
+            // a pty is not a pipe, so no tee() here. the buffer is already in our hands anyway
+            ssize_t numRecorded = write(c->recOut, c->pending, (size_t) numWritten);
+            c->outDropped += (int) (numWritten - (numRecorded > 0 ? numRecorded : 0));
+        }
+        c->pendingLen -= numWritten;
+        memmove(c->pending, c->pending + numWritten, (size_t) c->pendingLen);
+    }
+    c->outBlocked = false;
+}
+
+/**
+ * Read from a pty master into the session buffer.
+ * Small bursts are held back for up to coalesceUsec so that a screen update reaches the client in one write.
+ */
+void readTerminal(int clientIdx) {
+    client_t *c = &clients[clientIdx];
+    if (c->pending == nullptr) {
+        // keep the size we allocated, a reload may change coalesceLen in the middle of the session
+        c->pendingSize = config.coalesceLen;
+        c->pending = (char *) malloc((size_t) c->pendingSize);
+    }
+    if (c->outBlocked) {
+        // the client has room again, send what is waiting before reading more
+        flushTerminal(clientIdx);
+    }
+    while (!c->outBlocked) {
+        if (c->pendingLen == c->pendingSize) {
+            flushTerminal(clientIdx);
+            if (c->outBlocked) {
+                // leave the rest in the pty until the client catches up
+                break;
+            }
+        }
+        ssize_t numRead = read(c->out[0], c->pending + c->pendingLen, (size_t) (c->pendingSize - c->pendingLen));
+        if (numRead <= 0) {
+            // EAGAIN means we have drained it, anything else (EIO when the slave is gone) means flush now
+            if (numRead == 0 || errno != EAGAIN) {
+                flushTerminal(clientIdx);
+            }
+            break;
+        }
+        c->pendingLen += numRead;
+    }
+    if (c->pendingLen > 0 && !c->outBlocked) {
+        long long now = traceNow();
+        if (c->flushTime == 0) {
+            c->flushTime = now + config.coalesceUsec;
+        }
+        if (now >= c->flushTime) {
+            flushTerminal(clientIdx);
+        }
+    }
+}
+
+/**
+ * Flush terminal sessions whose coalescing window has passed
+ */
+void flushDueTerminals() {
+    long long now = traceNow();
+    for (int i = 0; i < clientCount; i++) {
+        if (clients[i].pendingLen > 0 && !clients[i].outBlocked && now >= clients[i].flushTime) {
+            flushTerminal(i);
+        }
+    }
+}
+
+/**
+ * How long select() may sleep before some terminal session has to be flushed, a finished session given up on,
+ * or an idle daemon has to exit
+ */
+void getSelectTimeout(struct timeval *timeout) {
+    long long wait = 3600LL * 1000000;
+    long long now = traceNow();
+    for (int i = 0; i < clientCount; i++) {
+        if (clients[i].pendingLen > 0 && !clients[i].outBlocked) {
+            long long left = clients[i].flushTime - now;
+            if (left < wait) {
+                wait = left > 0 ? left : 0;
+            }
+        }
+        if (clients[i].died && clients[i].pid > 0 && !clients[i].reaped) {
+            // the SIGCHLD of a killed child may come right before select(), don't sleep through it
+            if (wait > 10000) {
+                wait = 10000;
+            }
+        }
+        if (clients[i].fd > 0 && clients[i].died) {
+            // give up on a finished session whose client stopped reading
+            long long left = clients[i].exitTime + config.authTimeout * 1000000LL - now;
+            if (left < wait) {
+                wait = left > 0 ? left : 0;
+            }
+        }
+    }
+    for (int i = 0; i < INCOMING_MAX; i++) {
+        if (incoming[i].fd > 0) {
+            // drop connections that don't send their request right away
+            long long left = incoming[i].acceptTime + REQUEST_TIMEOUT * 1000000LL - now;
+            if (left < wait) {
+                wait = left > 0 ? left : 0;
+            }
+        }
+    }
+    long long flushTime = usageFlushTime();
+    if (flushTime > 0 && flushTime - now < wait) {
+        wait = flushTime > now ? flushTime - now : 0;
+    }
+    if (idleSince > 0) {
+        long long left = idleSince + config.idleExit * 1000000LL - now;
+        if (left < wait) {
+            wait = left > 0 ? left : 0;
+        }
+    }
+    timeout->tv_sec = wait / 1000000;
+    timeout->tv_usec = wait % 1000000;
+}
+
+/**
+ * Read control messages from a terminal client, currently only window size changes "W rows cols"
+ */
+void readControl(int clientIdx) {
+    char s[REQUEST_LEN];
+    memset(s, 0, sizeof(s));
+    ssize_t numRead = read(clients[clientIdx].errFd, s, sizeof(s) - 1);
+    if (numRead <= 0) {
+        return;
+    }
+    char *line = s;
+    while (line && *line) {
+        struct winsize ws;
+        int rows, cols;
+        memset(&ws, 0, sizeof(ws));
+        if (line[0] == WINDOW_CHANGE && sscanf(line + 1, "%d %d", &rows, &cols) == 2) {
+            LogV(DAEMON, "Window of client %d is now %dx%d", clients[clientIdx].fd, cols, rows);
+            ws.ws_row = (unsigned short) rows;
+            ws.ws_col = (unsigned short) cols;
+            ioctl(clients[clientIdx].out[0], TIOCSWINSZ, &ws);
+        }
+        line = strchr(line, '\n');
+        if (line) {
+            line++;
+        }
+    }
+}
+
+/**
+ * Move everything from a child pipe to a client socket with splice(), so the data never goes through userspace
+ * and each chunk costs one syscall instead of a read() and a write().
+ * If the session is recorded, each chunk is first tee()d into the recording pipe. tee() always starts at the head
+ * of the pipe, so we remember how much of the head is already recorded and splice exactly that much.
+ * @param tap recording pipe, 0 if none
+ * @param tapped bytes at the head of the pipe that are already recorded
+ * @param dropped counts the bytes that went to the client without being recorded
+ * @return true if the socket is full and the rest has to wait until it becomes writable
+ */
+bool forwardPipe(int from, int to, int tap, int *tapped, long long *bytes, int *dropped) {
+    while (true) {
+        size_t len = (size_t) config.forwardLen;
+        if (tap > 0) {
+            if (*tapped == 0) {
+                // a full recording pipe just means this chunk is not recorded
+                ssize_t numTeed = tee(from, tap, len, SPLICE_F_NONBLOCK);
+                if (numTeed > 0) {
+                    *tapped = (int) numTeed;
+                }
+            }
+            if (*tapped > 0) {
+                len = (size_t) *tapped;
+            }
+        }
+        ssize_t numMoved = splice(from, nullptr, to, nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (numMoved > 0) {
+            *bytes += numMoved;
+            if (*tapped > 0) {
+                *tapped -= numMoved;
+            }
+            else if (tap > 0) {
+                *dropped += (int) numMoved;
+            }
+            continue;
+        }
+        if (numMoved < 0 && errno == EAGAIN) {
+            // either the pipe is empty or the socket is full
+            int pending = 0;
+            ioctl(from, FIONREAD, &pending);
+            return pending > 0;
+        }
+        if (numMoved < 0 && errno == EINVAL) {
+            // no splice support for this pair, do it the old way
+            ssize_t numProxied = proxy(from, to, nothing);
+            *bytes += numProxied;
+            if (tap > 0) {
+                *dropped += (int) numProxied;
+            }
+            *tapped = 0;
+        }
+        return false;
+    }
+}
+
+/**
+ * Reap every child that has exited, so that none of them stays a zombie.
+ * SIGCHLDs can be merged, so we don't rely on the signal handler alone to mark sessions as died.
+ */
+void reapChildren() {
+    int status;
+    int pid;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        for (int i = 0; i < clientCount; i++) {
+            if (clients[i].pid == pid) {
+                if (!clients[i].died) {
+                    clients[i].exitTime = traceNow();
+                    clients[i].died = 1;
+                }
+                clients[i].usage = usage;
+                clients[i].reaped = 1;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Count our open file descriptors
+ */
+int countOpenFds() {
+    int count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == nullptr) {
+        return -1;
+    }
+    while (readdir(dir) != nullptr) {
+        count++;
+    }
+    closedir(dir);
+    // ".", ".." and the fd of the directory itself
+    return count - 3;
+}
+
+/**
+ * When the last session is gone we must be back to the fds we had at startup. Anything more is a leak.
+ */
+void checkIdleFds() {
+    for (int i = 0; i < clientCount; i++) {
+        if (clients[i].fd > 0) {
+            return;
+        }
+    }
+    // the recorders outlive the sessions, their sockets are not leaks
+    int count = countOpenFds() - countRecorders();
+    if (count > idleFdCount) {
+        LogE(DAEMON, "Leaked %d fds while serving clients", count - idleFdCount);
+        idleFdCount = count;
+    }
+}
+
 /**
  * Disconnect all clients that are associated with 'marked' died children
  * Closing the pipes to the children too.
  */
 void disconnectDeadClients() {
-    for (int i = 0; i < MAX_CLIENT; i++) {
+    bool disconnected = false;
+    reapChildren();
+    for (int i = 0; i < clientCount; i++) {
         if (clients[i].died) {
             LogV(DAEMON, " - Child %d died, disconnecting client %d", clients[i].pid, clients[i].fd);
+            long long teardownTime = traceNow();
+            if (clients[i].clientGone) {
+                // nobody to deliver to, the sockets are shut down already
+            }
+            else if (clients[i].pty) {
+                // whatever is still in the terminal buffer goes out before we close
+                readTerminal(i);
+                flushTerminal(i);
+            }
+            else {
+                // same for whatever the child left in its pipes
+                clients[i].outBlocked = forwardPipe(clients[i].out[0], clients[i].fd, clients[i].recOut, &clients[i].outTapped, &clients[i].bytes, &clients[i].outDropped);
+            }
+            if (clients[i].errFd > 0 && !clients[i].clientGone) {
+                clients[i].errBlocked = forwardPipe(clients[i].err[0], clients[i].errFd, clients[i].recErr, &clients[i].errTapped, &clients[i].bytes, &clients[i].errDropped);
+            }
+
+            // a short command can be done before its client has read everything or even connected its stderr socket.
+            // keep the session until then, but not forever
+            int errPending = 0;
+            if (!clients[i].pty && !clients[i].clientGone && clients[i].errFd <= 0) {
+                ioctl(clients[i].err[0], FIONREAD, &errPending);
+            }
+            if ((clients[i].outBlocked || clients[i].errBlocked || errPending > 0) &&
+                traceNow() - clients[i].exitTime < config.authTimeout * 1000000LL) {
+                continue;
+            }
+            if (clients[i].pid > 0 && !clients[i].reaped) {
+                // killed but not reaped yet, its usage is only known once wait4() returns for it
+                continue;
+            }
+            free(clients[i].pending);
+
+            // account the session, and tell the client if it asked
+            addUsage(&clients[i]);
+            if ((clients[i].flags & REQUEST_USAGE) && clients[i].errFd > 0 && !clients[i].clientGone) {
+                char usage[256];
+                formatUsage(&clients[i], usage, sizeof(usage));
+                send(clients[i].errFd, usage, strlen(usage), MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
             close(clients[i].in[0]);
             close(clients[i].in[1]);
             close(clients[i].out[0]);
@@ -102,58 +449,214 @@ void disconnectDeadClients() {
             close(clients[i].err[0]);
             close(clients[i].err[1]);
             close(clients[i].fd);
-            close(clients[i].errFd);
+            if (clients[i].errFd > 0) {
+                // not there if the client went away before connecting its stderr, and 0 is our own stdin
+                close(clients[i].errFd);
+            }
+            if (clients[i].recOut > 0) {
+                // the recorder of the uid stays, it just sees EOF on this session
+                reportDropped(i);
+                close(clients[i].recOut);
+                close(clients[i].recErr);
+            }
             LogV(DAEMON, " - Closing following fds: in [%d %d] out [%d %d] err [%d %d] sock [%d %d]", clients[i].in[0], clients[i].in[1], clients[i].out[0], clients[i].out[1], clients[i].err[0], clients[i].err[1], clients[i].fd, clients[i].errFd);
-            clients[i].died = 0;
-            clients[i].pid = 0;
-            clients[i].fd = 0;
+            traceSpan("teardown", clients[i].session, teardownTime);
+            if (clients[i].exitTime) {
+                traceRange("child", clients[i].session, clients[i].forkTime, clients[i].exitTime);
+            }
+            traceSpan("session", clients[i].session, clients[i].startTime);
+            memset(&clients[i], 0, sizeof(client_t));
+            disconnected = true;
+        }
+    }
+    if (disconnected) {
+        checkIdleFds();
+    }
+}
+
+/**
+ * Exit once we have been without sessions for idle_exit seconds. Only when started by -a, which holds the
+ * sockets and starts us again on the next connection.
+ */
+void checkIdleExit() {
+    if (!activated || config.idleExit <= 0 || incomingUsed > 0) {
+        idleSince = 0;
+        return;
+    }
+    for (int i = 0; i < clientCount; i++) {
+        if (clients[i].fd > 0) {
+            idleSince = 0;
+            return;
         }
     }
+    long long now = traceNow();
+    if (idleSince == 0) {
+        idleSince = now;
+    }
+    else if (now - idleSince >= config.idleExit * 1000000LL) {
+        LogI(DAEMON, "No sessions for %d s, exiting", config.idleExit);
+        flushUsageStats(true);
+        exit(0);
+    }
 }
 
 /**
- * Add all possible file descriptors to a readset for later select()
+ * Add all possible file descriptors to a readset (and writeset, for clients that can't keep up) for later select()
  */
-int addDaemonFdsToReadset(fd_set *readset) {
+int addDaemonFdsToSets(fd_set *readset, fd_set *writeset) {
     FD_ZERO(readset);                     // clear the set
-    FD_SET(listenFd, readset);            // add listening socket to the set
+    FD_ZERO(writeset);
+    if (incomingUsed < INCOMING_MAX) {
+        // otherwise leave new connections in the backlog until a request has come in
+        FD_SET(listenFd, readset);        // add listening socket to the set
+    }
     FD_SET(listenErrFd, readset);         // add listening socket to the set
     int maxfd = listenFd;
     if (maxfd < listenErrFd) {
         maxfd = listenErrFd;
     }
+    for (int i = 0; i < INCOMING_MAX; i++) {
+        if (incoming[i].fd > 0) {
+            FD_SET(incoming[i].fd, readset);
+            if (incoming[i].fd > maxfd) maxfd = incoming[i].fd;
+        }
+    }
 
-    for (int i = 0; i < MAX_CLIENT; i++) {
+    for (int i = 0; i < clientCount; i++) {
         if (clients[i].fd > 0 && !clients[i].died) {
             FD_SET(clients[i].fd, readset);    // add a FD into the set
             if (clients[i].fd > maxfd) maxfd = clients[i].fd;
-            FD_SET(clients[i].out[0], readset);
-            if (clients[i].out[0] > maxfd) maxfd = clients[i].out[0];
-            FD_SET(clients[i].err[0], readset);
-            if (clients[i].err[0] > maxfd) maxfd = clients[i].err[0];
+            // while a client socket is full, wait for it instead of the child output
+            if (clients[i].outBlocked) {
+                FD_SET(clients[i].fd, writeset);
+            }
+            else {
+                FD_SET(clients[i].out[0], readset);
+                if (clients[i].out[0] > maxfd) maxfd = clients[i].out[0];
+            }
+            // child stderr stays in its pipe until the client has connected its stderr socket
+            if (clients[i].errFd > 0 && clients[i].errBlocked) {
+                FD_SET(clients[i].errFd, writeset);
+                if (clients[i].errFd > maxfd) maxfd = clients[i].errFd;
+            }
+            else if (clients[i].errFd > 0) {
+                FD_SET(clients[i].err[0], readset);
+                if (clients[i].err[0] > maxfd) maxfd = clients[i].err[0];
+            }
+            if (clients[i].pty && clients[i].errFd > 0) {
+                // window size changes come through the stderr socket
+                FD_SET(clients[i].errFd, readset);
+                if (clients[i].errFd > maxfd) maxfd = clients[i].errFd;
+            }
+        }
+        else if (clients[i].fd > 0) {
+            // a finished session still flushing its output to a slow client
+            if (clients[i].outBlocked) {
+                FD_SET(clients[i].fd, writeset);
+                if (clients[i].fd > maxfd) maxfd = clients[i].fd;
+            }
+            if (clients[i].errFd > 0 && clients[i].errBlocked) {
+                FD_SET(clients[i].errFd, writeset);
+                if (clients[i].errFd > maxfd) maxfd = clients[i].errFd;
+            }
         }
     }
     return maxfd;
 }
 
+/**
+ * Open a pseudo terminal for a client. The master side replaces both the stdin and stdout pipes,
+ * the child opens the slave side in execShell().
+ */
+bool openTerminal(int clientIdx, request_t *req) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        LogE(DAEMON, "Cannot open pty. Error %s", strerror(errno));
+        if (master >= 0) {
+            close(master);
+        }
+        return false;
+    }
+
+    struct winsize ws;
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_row = (unsigned short) req->rows;
+    ws.ws_col = (unsigned short) req->cols;
+    ioctl(master, TIOCSWINSZ, &ws);
+    markNonblock(master);
+    markCloexec(master);
+
+    clients[clientIdx].pty = 1;
+    clients[clientIdx].in[0] = -1;
+    clients[clientIdx].in[1] = fcntl(master, F_DUPFD_CLOEXEC, 0);
+    clients[clientIdx].out[0] = master;
+    clients[clientIdx].out[1] = -1;
+    return true;
+}
+
+/**
+ * Resize the #clients list. It never shrinks below the highest slot in use, so no session is dropped.
+ */
+void resizeClients(int count) {
+    for (int i = count; i < clientCount; i++) {
+        if (clients[i].fd > 0) {
+            count = i + 1;
+        }
+    }
+    if (count == clientCount) {
+        return;
+    }
+
+    // the SIGCHLD handler walks the list, keep it out while we move it
+    sigset_t mask, oldMask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &oldMask);
+    client_t *resized = (client_t *) realloc(clients, sizeof(client_t) * count);
+    if (resized != nullptr) {
+        if (count > clientCount) {
+            memset(resized + clientCount, 0, sizeof(client_t) * (count - clientCount));
+        }
+        clients = resized;
+        clientCount = count;
+    }
+    sigprocmask(SIG_SETMASK, &oldMask, nullptr);
+    LogV(DAEMON, "Client list has %d slots", clientCount);
+}
+
+/**
+ * Re-read the config. Sessions keep running, new limits apply to what comes next.
+ */
+void reloadConfig() {
+    LogI(DAEMON, "Reloading %s", CONFIG_PATH);
+    reloadRequested = 0;
+    loadConfig();
+    loadPolicy();
+    resizeClients(config.maxClient);
+    // listen() again on a listening socket just updates its backlog
+    listen(listenFd, config.backlog);
+    listen(listenErrFd, config.backlog);
+}
+
 /**
  * Add a clientfd to the #clients list
- * Create pipes to communicate with its corresponding child
+ * Create pipes (or a pty) to communicate with its corresponding child
  */
-int addClientToList(int clientFd) {
+int addClientToList(int clientFd, request_t *req) {
     markNonblock(clientFd);
 
     // add it to the client array so that we can include it in client fdset
     int clientIdx = -1;
-    for (int i = 0; i < MAX_CLIENT; i++) {
+    for (int i = 0; i < clientCount; i++) {
         if (clients[i].fd == 0) {
             clients[i].fd = clientFd;
-            pipe(clients[i].in);
-            pipe(clients[i].out);
-            pipe(clients[i].err);
-
-            markNonblock(clients[i].in[0]);
-            markNonblock(clients[i].out[0]);
+            if (req->mode != MODE_TERMINAL || !openTerminal(i, req)) {
+                pipe2(clients[i].in, O_CLOEXEC);
+                pipe2(clients[i].out, O_CLOEXEC);
+                markNonblock(clients[i].in[0]);
+                markNonblock(clients[i].out[0]);
+            }
+            pipe2(clients[i].err, O_CLOEXEC);
             markNonblock(clients[i].err[0]);
 
             clientIdx = i;
@@ -164,24 +667,60 @@ int addClientToList(int clientFd) {
 }
 
 /**
- * Exec a shell to serve a client. Redirect stdin/stdout/stderr of the child to 3 pipes.
+ * Exec a shell to serve a client, with -c if the client sent a command. Redirect stdin/stdout/stderr of the child
+ * to 3 pipes, or to the slave side of its pty in terminal mode.
  * We will forward these data to the client using these pipes.
  */
-void execShell(int clientIdx) {
-    char *argv[2];
+void execShell(int clientIdx, request_t *req) {
+    char *argv[4];
     int argc = 0;
-    argv[argc++] = DEFAULT_SHELL;
+    argv[argc++] = config.shell;
+    if (req->command) {
+        argv[argc++] = (char *) "-c";
+        argv[argc++] = req->command;
+    }
     argv[argc] = nullptr;
 
+    // apply the scheduling policy of the calling uid, if any
+    priority_t prio;
+    if (loadPriority(clients[clientIdx].uid, &prio)) {
+        LogV(DAEMON, "Applying scheduling policy for uid %d", clients[clientIdx].uid);
+        applyPriority(&prio);
+    }
+
     // redirect
-    dup2(clients[clientIdx].in[0], STDIN_FILENO);           // child input to stdin pipe 0
-    dup2(clients[clientIdx].out[1], STDOUT_FILENO);         // child output to stdout pipe 1
-    dup2(clients[clientIdx].err[1], STDERR_FILENO);         // child err to stderr pipe 1
+    if (clients[clientIdx].pty) {
+        // new session so that the pty becomes our controlling terminal
+        setsid();
+        int slave = open(ptsname(clients[clientIdx].out[0]), O_RDWR);
+        if (slave < 0) {
+            LogE(DAEMON, "Cannot open pty slave. Error %s", strerror(errno));
+            exit(1);
+        }
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        close(slave);
+        close(clients[clientIdx].out[0]);
+        close(clients[clientIdx].in[1]);
+        if (req->term[0]) {
+            setenv("TERM", req->term, 1);
+        }
+    }
+    else {
+        dup2(clients[clientIdx].in[0], STDIN_FILENO);           // child input to stdin pipe 0
+        dup2(clients[clientIdx].out[1], STDOUT_FILENO);         // child output to stdout pipe 1
+        dup2(clients[clientIdx].err[1], STDERR_FILENO);         // child err to stderr pipe 1
+    }
 
     setenv("HOME", "/sdcard", 1);
-    setenv("SHELL", DEFAULT_SHELL, 1);
+    setenv("SHELL", config.shell, 1);
     setenv("USER", "root", 1);
     setenv("LOGNAME", "root", 1);
+    // we ignore SIGPIPE, root shells must not inherit that
+    signal(SIGPIPE, SIG_DFL);
+    traceInstant("exec", clients[clientIdx].session);
     execvp(argv[0], argv);
 
     // if code goes here, meaning we have problems with execvp
@@ -189,38 +728,75 @@ void execShell(int clientIdx) {
     exit(1);
 }
 
+/**
+ * Mark the first time a child produces output
+ */
+void traceFirstOutput(int clientIdx) {
+    if (!clients[clientIdx].gotOutput) {
+        clients[clientIdx].gotOutput = 1;
+        traceInstant("first output", clients[clientIdx].session);
+    }
+}
+
 /**
  * Forward data between children and clients
  */
-void forwardData(fd_set *readSet) {
-    for (int i = 0; i < MAX_CLIENT; i++) {
+void forwardData(fd_set *readSet, fd_set *writeSet) {
+    for (int i = 0; i < clientCount; i++) {
         // is that data from a child stdout? forward to the client stdout
-        if (clients[i].fd > 0 && FD_ISSET(clients[i].out[0], readSet)) {
+        if (clients[i].fd > 0 && (FD_ISSET(clients[i].out[0], readSet) ||
+                                  (clients[i].outBlocked && FD_ISSET(clients[i].fd, writeSet)))) {
             // forward to the client
-            proxy(clients[i].out[0], clients[i].fd, nothing);
+            traceFirstOutput(i);
+            long long forwardTime = traceNow();
+            if (clients[i].pty) {
+                readTerminal(i);
+            }
+            else {
+                clients[i].outBlocked = forwardPipe(clients[i].out[0], clients[i].fd, clients[i].recOut, &clients[i].outTapped, &clients[i].bytes, &clients[i].outDropped);
+            }
+            traceSpan("forward stdout", clients[i].session, forwardTime);
+        }
+
+        // is that a control message from a terminal client?
+        if (clients[i].fd > 0 && clients[i].pty && clients[i].errFd > 0 && FD_ISSET(clients[i].errFd, readSet)) {
+            readControl(i);
         }
 
         // is that data from a child stderr? forward to the client stderr
-        if (clients[i].fd > 0 && FD_ISSET(clients[i].err[0], readSet)) {
+        if (clients[i].fd > 0 && clients[i].errFd > 0 && (FD_ISSET(clients[i].err[0], readSet) ||
+                                  (clients[i].errBlocked && FD_ISSET(clients[i].errFd, writeSet)))) {
             // forward to the client
-            proxy(clients[i].err[0], clients[i].errFd, nothing);
+            traceFirstOutput(i);
+            long long forwardTime = traceNow();
+            clients[i].errBlocked = forwardPipe(clients[i].err[0], clients[i].errFd, clients[i].recErr, &clients[i].errTapped, &clients[i].bytes, &clients[i].errDropped);
+            traceSpan("forward stderr", clients[i].session, forwardTime);
+        }
+        if (clients[i].outDropped > 0 || clients[i].errDropped > 0) {
+            reportDropped(i);
         }
 
         // is that data from a previously-connect client?
         if (clients[i].fd > 0 && FD_ISSET(clients[i].fd, readSet)) {
             // forward to the corresponding child's stdin
-            proxy(clients[i].fd, clients[i].in[1], [](int from) {
+            clients[i].bytes += proxy(clients[i].fd, clients[i].in[1], [](int from) {
                 // some error. remove it from the "active" fd array
                 LogV(DAEMON, " - Client %d has disconnected.", from);
                 shutdown(from, SHUT_RDWR);
                 // we dont close from here, we will do it in disconnectDeadClients();
 
                 // find the child
-                for (int j = 0; j < MAX_CLIENT; j++) {
+                for (int j = 0; j < clientCount; j++) {
                     if (clients[j].fd == from) {
                         // kill the child
-                        kill(clients[j].pid, SIGKILL);
+                        if (clients[j].pid > 0) {
+                            kill(clients[j].pid, SIGKILL);
+                        }
                         clients[j].died = 1;
+                        // and forward nothing more to the socket we just shut down
+                        clients[j].clientGone = 1;
+                        clients[j].outBlocked = 0;
+                        clients[j].errBlocked = 0;
                         break;
                     }
                 }
@@ -230,46 +806,24 @@ void forwardData(fd_set *readSet) {
 }
 
 /**
- * Check whether or not we accept su requests from this client
+ * Get the pid of the process on the other side of a socket. Used to correlate traces.
  */
-bool authClient(int clientFd) {
-    char uids[8];
+int getPeerPid(int clientFd) {
 #if defined(SO_PEERCRED)
     struct ucred cred;
     socklen_t credLen = sizeof(cred);
     memset(&cred, 0, credLen);
     getsockopt(clientFd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen);
-    sprintf(uids, "%d", cred.uid);
-    int uid = cred.uid;
+    return cred.pid;
 #else
-    uid_t uid;
-    gid_t gid;
-    getpeereid(clientFd, &uid, &gid);
-    sprintf(uids, "%d", uid);
-    LogI(DAEMON, "Client uid is %d, gid is %d", uid, gid);
+    return clientFd;
 #endif
+}
 
-    // check if we are already trusted
-    char line[128];
-    FILE* file = fopen(AUTH_TRUSTED, "r");
-    if (file) {
-        memset(line, 0, sizeof(line));
-        while (fgets(line, sizeof(line), file)) {
-            // remove trailing \n
-            int len = strlen(line);
-            if (line[len] == '\n') {
-                line[len] = 0;
-            }
-            int readUid = atoi(line);
-            if (readUid == uid) {
-                // ok it's there...
-                LogV(DAEMON, "Trusted uid %d.", readUid);
-                return true;
-            }
-        }
-        fclose(file);
-    }
-
+/**
+ * Start the RequestActivity and wait for its decision
+ */
+bool waitForUser(int uid, char *uids) {
     // create a new socket to wait for response from activity
     char path[32];
     sprintf(path, "/su/tinysu.%d.auth", uid);
@@ -289,11 +843,13 @@ bool authClient(int clientFd) {
     };
 
     int clientPid = fork();
-    if (clientPid != 0) {
+    if (clientPid == 0) {
         // child, do exec
         setenv("CLASSPATH", "/system/framework/am.jar", 1);
+        signal(SIGPIPE, SIG_DFL);
         execvp(argv[0], argv);
-        return false;
+        LogE(DAEMON, "Error execvp am");
+        exit(1);
     }
 
     // parent. wait for response from activity
@@ -307,7 +863,7 @@ bool authClient(int clientFd) {
     memset(&caddr, 0, clen);
 
     memset(&timeout, 0, sizeof(timeout));
-    timeout.tv_sec = AUTH_TIMEOUT;
+    timeout.tv_sec = config.authTimeout;
 
     while (true) {
         FD_ZERO(&readSet);
@@ -320,6 +876,10 @@ bool authClient(int clientFd) {
             }
         }
         int selectVal = select(maxfd + 1, &readSet, nullptr, nullptr, &timeout);
+        if (selectVal < 0 && errno == EINTR) {
+            // most likely am exiting, keep waiting for the rest of the timeout
+            continue;
+        }
         if (selectVal > 0) {
             if (FD_ISSET(sockfd, &readSet)) {
                 responseFd = accept(sockfd, (struct sockaddr *) &caddr, &clen);
@@ -375,49 +935,284 @@ bool authClient(int clientFd) {
 }
 
 /**
- * Accept incoming connections
+ * Ask the user through our RequestActivity
+ */
+bool askUser(int uid, int session) {
+    char uids[8];
+    sprintf(uids, "%d", uid);
+    long long promptTime = traceNow();
+    bool allowed = waitForUser(uid, uids);
+    traceSpan("prompt", session, promptTime);
+    return allowed;
+}
+
+/**
+ * Check whether or not we accept su requests from this client
+ * @param uid receives the uid of the client
+ * @param req what the client asked for, checked against the command policy
+ */
+bool authClient(int clientFd, int *uid, int session, request_t *req) {
+    long long credTime = traceNow();
+#if defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    memset(&cred, 0, credLen);
+    getsockopt(clientFd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen);
+    *uid = cred.uid;
+#else
+    uid_t peerUid;
+    gid_t gid;
+    getpeereid(clientFd, &peerUid, &gid);
+    *uid = peerUid;
+    LogI(DAEMON, "Client uid is %d, gid is %d", peerUid, gid);
+#endif
+    traceSpan("peercred", session, credTime);
+
+    // rules for this exact command?
+    int decision = checkPolicy(*uid, req->command);
+    if (decision != POLICY_NONE) {
+        LogV(DAEMON, "Command policy %s uid %d", decision == POLICY_ALLOW ? "allows" : "denies", *uid);
+        return decision == POLICY_ALLOW;
+    }
+
+#ifdef AUTH_STUB
+    char *stub = getenv(AUTH_STUB);
+    if (stub) {
+        return strcmp(stub, "allow") == 0;
+    }
+#endif
+
+    // check if we are already trusted
+    long long trustedTime = traceNow();
+    char line[128];
+    FILE* file = fopen(AUTH_TRUSTED, "r");
+    if (file) {
+        memset(line, 0, sizeof(line));
+        while (fgets(line, sizeof(line), file)) {
+            // remove trailing \n
+            int len = strlen(line);
+            if (line[len] == '\n') {
+                line[len] = 0;
+            }
+            int readUid = atoi(line);
+            if (readUid == *uid) {
+                // ok it's there...
+                LogV(DAEMON, "Trusted uid %d.", readUid);
+                fclose(file);
+                traceSpan("trusted", session, trustedTime);
+                return true;
+            }
+        }
+        fclose(file);
+    }
+    traceSpan("trusted", session, trustedTime);
+    return askUser(*uid, session);
+}
+
+/**
+ * Has the peer closed its side of a socket?
+ */
+bool peerClosed(int fd) {
+    struct pollfd pfd = {fd, POLLRDHUP, 0};
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR));
+}
+
+/**
+ * Read the session request the client sends right after connecting: "<mode> <rows> <cols> <term> <flags> <cmdlen>\n"
+ * followed by cmdlen bytes of command in command mode.
+ * Nothing is consumed until all of it has arrived, so that we never wait on a client in the middle of it.
+ * @return false if the request is not complete yet. req->mode is MODE_INVALID for a broken request
+ */
+bool readRequest(int clientFd, request_t *req) {
+    char s[REQUEST_LEN];
+    memset(req, 0, sizeof(request_t));
+    req->mode = MODE_INVALID;
+
+    memset(s, 0, sizeof(s));
+    ssize_t numRead = recv(clientFd, s, sizeof(s) - 1, MSG_PEEK);
+    if (numRead < 0 && errno == EAGAIN) {
+        return false;
+    }
+    if (numRead <= 0) {
+        return true;
+    }
+    char *end = strchr(s, '\n');
+    if (end == nullptr) {
+        // no request line is that long
+        return numRead == sizeof(s) - 1 || peerClosed(clientFd);
+    }
+    *end = 0;
+    int lineLen = (int) (end - s + 1);
+
+    int commandLen = 0;
+    sscanf(s, "%c %d %d %31s %d %d", &req->mode, &req->rows, &req->cols, req->term, &req->flags, &commandLen);
+    if (strcmp(req->term, "-") == 0) {
+        req->term[0] = 0;
+    }
+    if (commandLen < 0 || commandLen > COMMAND_MAX) {
+        req->mode = MODE_INVALID;
+        return true;
+    }
+
+    int available = 0;
+    ioctl(clientFd, FIONREAD, &available);
+    if (available < lineLen + commandLen) {
+        if (peerClosed(clientFd)) {
+            // a truncated command must not run
+            req->mode = MODE_INVALID;
+            return true;
+        }
+        return false;
+    }
+    read(clientFd, s, (size_t) lineLen);
+    if (commandLen > 0) {
+        req->command = (char *) calloc((size_t) commandLen + 1, 1);
+        int got = 0;
+        while (got < commandLen) {
+            numRead = read(clientFd, req->command + got, (size_t) (commandLen - got));
+            if (numRead <= 0) {
+                break;
+            }
+            got += numRead;
+        }
+    }
+    LogV(DAEMON, "Client %d requests mode %c", clientFd, req->mode);
+    return true;
+}
+
+/**
+ * Authenticate a client whose request has arrived, and start its shell
  */
-void acceptClient(int listenFd) {
+void startSession(int clientFd, int session, long long acceptTime, request_t *req) {
     char s[16];
+    int clientPid;
+    int uid = -1;
+
+    long long authTime = traceNow();
+    bool authorized = authClient(clientFd, &uid, session, req);
+    traceSpan("auth", session, authTime);
+    authTime = traceNow() - authTime;
+    if (!authorized) {
+        LogE(DAEMON, "Unauthorized access for client %d", clientFd);
+        free(req->command);
+        close(clientFd);
+        return;
+    }
+
+    int clientIdx = addClientToList(clientFd, req);
+    if (clientIdx < 0) {
+        LogE(DAEMON, "Too many clients, dropping client %d", clientFd);
+        free(req->command);
+        close(clientFd);
+        return;
+    }
+
+    // welcome with its id. the shell may start writing right after it, so end it with a newline
+    memset(s, 0, sizeof(s));
+    sprintf(s, "%d\n", clientFd);
+    write(clientFd, s, strlen(s));
+    clients[clientIdx].uid = uid;
+    clients[clientIdx].session = session;
+    clients[clientIdx].startTime = acceptTime;
+    clients[clientIdx].flags = req->flags;
+    clients[clientIdx].authTime = authTime;
+    if (shouldRecord(uid)) {
+        startRecording(clientIdx);
+    }
+
+    // pre-fork
+    long long forkTime = traceNow();
+    clientPid = fork();
+    if (clientPid == 0) {
+        // we are child.
+        execShell(clientIdx, req);
+    }
+    else if (clientPid < 0) {
+        LogE(DAEMON, "Cannot fork a shell for client %d. Error %s", clientFd, strerror(errno));
+        clients[clientIdx].died = 1;
+        free(req->command);
+    }
+    else {
+        // parent. save pid to the list
+        traceSpan("fork", session, forkTime);
+        clients[clientIdx].forkTime = forkTime;
+        clients[clientIdx].spawnTime = traceNow() - forkTime;
+        clients[clientIdx].pid = clientPid;
+        free(req->command);
+    }
+}
+
+/**
+ * Accept an incoming connection. Its request is read once it arrives, see readIncoming()
+ * @return false when there is nothing left to accept
+ */
+bool acceptClient(int listenFd) {
     struct sockaddr_in caddr;
     unsigned int clen = sizeof(caddr);
-    int clientFd;
-    int clientPid;
+    long long acceptTime = traceNow();
+    if (incomingUsed == INCOMING_MAX) {
+        return false;
+    }
     memset(&caddr, 0, sizeof(caddr));
-    clientFd = accept(listenFd, (struct sockaddr *) &caddr, &clen);
+    int clientFd = accept(listenFd, (struct sockaddr *) &caddr, &clen);
     if (clientFd > 0) {
         LogI(DAEMON, "New client %d", clientFd);
-
-        if (!authClient(clientFd)) {
-            LogE(DAEMON, "Unauthorized access for client %d", clientFd);
-            close(clientFd);
-            return;
+        markCloexec(clientFd);
+        markNonblock(clientFd);
+        int session = getPeerPid(clientFd);
+        traceSpan("accept", session, acceptTime);
+        for (int i = 0; i < INCOMING_MAX; i++) {
+            if (incoming[i].fd == 0) {
+                incoming[i].fd = clientFd;
+                incoming[i].session = session;
+                incoming[i].acceptTime = acceptTime;
+                incomingUsed++;
+                break;
+            }
         }
+    }
+    return clientFd > 0;
+}
 
-        // welcome with its id
-        memset(s, 0, sizeof(s));
-        sprintf(s, "%d", clientFd);
-        write(clientFd, s, strlen(s));
-
-        int clientIdx = addClientToList(clientFd);
-
-        // pre-fork
-        clientPid = fork();
-        if (clientPid == 0) {
-            // we are child.
-            execShell(clientIdx);
+/**
+ * Start sessions for connections whose request has arrived, drop those that took too long.
+ * Reading a request never blocks, so we just look at all of them, including the ones accepted a moment ago.
+ */
+void readIncoming() {
+    long long now = traceNow();
+    for (int i = 0; i < INCOMING_MAX; i++) {
+        if (incoming[i].fd <= 0) {
+            continue;
         }
-        else {
-            // parent. save pid to the list
-            clients[clientIdx].pid = clientPid;
+        incoming_t conn = incoming[i];
+        request_t req;
+        if (!readRequest(conn.fd, &req)) {
+            if (now - conn.acceptTime >= REQUEST_TIMEOUT * 1000000LL) {
+                LogE(DAEMON, "No request from client %d", conn.fd);
+                close(conn.fd);
+                memset(&incoming[i], 0, sizeof(incoming_t));
+                incomingUsed--;
+            }
+            continue;
+        }
+        memset(&incoming[i], 0, sizeof(incoming_t));
+        incomingUsed--;
+        traceSpan("request", conn.session, conn.acceptTime);
+        if (req.mode == MODE_INVALID) {
+            LogE(DAEMON, "Bad request from client %d", conn.fd);
+            free(req.command);
+            close(conn.fd);
+            continue;
         }
+        startSession(conn.fd, conn.session, conn.acceptTime, &req);
     }
 }
 
 /**
- * Accept incoming connections
+ * Accept an incoming stderr connection
+ * @return false when there is nothing left to accept
  */
-void acceptClientErr(int listenErrFd) {
+bool acceptClientErr(int listenErrFd) {
     char s[16];
     struct sockaddr_in caddr;
     unsigned int clen = sizeof(caddr);
@@ -433,15 +1228,19 @@ void acceptClientErr(int listenErrFd) {
         read(clientErrFd, s, sizeof(s));
         clientId = atoi(s);
 
-        for (int i = 0; i < MAX_CLIENT; i++) {
+        for (int i = 0; i < clientCount; i++) {
             if (clients[i].fd == clientId) {
                 LogV(DAEMON, "Matching clientErrFd %d with clientFd %d", clientErrFd, clientId);
+                markNonblock(clientErrFd);
+                markCloexec(clientErrFd);
                 clients[i].errFd = clientErrFd;
-                return;
+                return true;
             }
         }
+        // nobody is waiting for it
+        close(clientErrFd);
     }
-
+    return clientErrFd > 0;
 }
 
 /**
@@ -449,17 +1248,17 @@ void acceptClientErr(int listenErrFd) {
  */
 void serveClients(int listenFd, int listenErrFd) {
     fd_set readSet;
+    fd_set writeSet;
     struct timeval timeout = {10, 0};
     memset(&timeout, 0, sizeof(timeout));
-    registerSignalHandler();
     LogV(DAEMON, "Serving clients on sock %d and sockErr %d", listenFd, listenErrFd);
 
     while (true) {
-        int maxfd = addDaemonFdsToReadset(&readSet);
+        int maxfd = addDaemonFdsToSets(&readSet, &writeSet);
 
         // pool and wait
-        timeout.tv_sec = 3600;
-        int selectVal = select(maxfd + 1, &readSet, nullptr, nullptr, &timeout);
+        getSelectTimeout(&timeout);
+        int selectVal = select(maxfd + 1, &readSet, &writeSet, nullptr, &timeout);
         if (selectVal < 0) {
             if (errno != EINTR) {
                 perror("select");
@@ -475,17 +1274,31 @@ void serveClients(int listenFd, int listenErrFd) {
         }
         else if (selectVal > 0) {
             // is that an incoming connection from the listening socket?
+            // take everything that is queued in one go
             if (FD_ISSET(listenFd, &readSet)) {
-                acceptClient(listenFd);
+                while (acceptClient(listenFd));
             }
             // is that an incoming connection from the listening socket for stderr?
             if (FD_ISSET(listenErrFd, &readSet)) {
-                acceptClientErr(listenErrFd);
+                while (acceptClientErr(listenErrFd));
             }
             // is that data from children or clients?
-            forwardData(&readSet);
+            forwardData(&readSet, &writeSet);
         }
+        // requests of new connections, and the ones that are overdue
+        readIncoming();
+        flushDueTerminals();
         disconnectDeadClients();
+        if (reloadRequested) {
+            reloadConfig();
+        }
+        flushUsageStats(false);
+        if (exitRequested) {
+            LogI(DAEMON, "Exiting on request");
+            flushUsageStats(true);
+            exit(0);
+        }
+        checkIdleExit();
     }
 }
 
@@ -496,9 +1309,38 @@ void goDaemonMode() {
     LogI(DAEMON, "This is TinySU ver %s.", TINYSU_VER_STR);
     LogI(DAEMON, "Operating in daemon mode.");
 
+    // handlers first, -a may already be sending us SIGHUP, which it kept blocked for us until now
+    registerSignalHandler();
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+
+    // a client that goes away in the middle of a write must cost us an EPIPE, not our life
+    signal(SIGPIPE, SIG_IGN);
+
+    // fd 0 means a free slot everywhere, so a connection must never be accepted on it
+    int nullFd;
+    while ((nullFd = open("/dev/null", O_RDWR)) >= 0 && nullFd <= STDERR_FILENO);
+    if (nullFd > STDERR_FILENO) {
+        close(nullFd);
+    }
     mkdir("/su", 0777);
-    memset(clients, 0, sizeof(clients));
-    listenFd = initListeningSocket(TINYSU_SOCKET_PATH);
-    listenErrFd = initListeningSocket(TINYSU_SOCKET_ERR_PATH);
+    resizeClients(config.maxClient);
+    loadPolicy();
+    loadUsageStats();
+    char *fds = getenv(LISTEN_FDS_ENV);
+    if (fds != nullptr && sscanf(fds, "%d,%d", &listenFd, &listenErrFd) == 2) {
+        // started by -a, the sockets are bound already and a client is waiting on them
+        unsetenv(LISTEN_FDS_ENV);
+        markCloexec(listenFd);
+        markCloexec(listenErrFd);
+        activated = true;
+    }
+    else {
+        listenFd = initListeningSocket(config.socketPath);
+        listenErrFd = initListeningSocket(config.socketErrPath);
+    }
+    idleFdCount = countOpenFds();
     serveClients(listenFd, listenErrFd);
 }
\ No newline at end of file
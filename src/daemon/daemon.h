@@ -4,4 +4,5 @@
 
 #pragma once
 
+int initListeningSocket(char *path);
 void goDaemonMode();
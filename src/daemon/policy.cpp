@@ -0,0 +1,214 @@
+/*
+ * Per-uid command rules, so that known tools can run known commands without a prompt.
+ * Each line of COMMAND_POLICY looks like
+ *
+ *     <uid|*> <allow|deny> <command>
+ *
+ * A command ending with '*' matches anything starting with what comes before it, otherwise it must match exactly.
+ * What a '*' matches must not contain shell metacharacters, so "pm list *" does not allow "pm list; reboot".
+ * Exact beats prefix, longer prefix beats shorter, deny beats allow, and rules of the uid beat '*' rules.
+ * No match means the normal trusted/prompt flow.
+ *
+ * The rules are compiled into one trie per uid when the daemon starts and on SIGHUP, so a check is a single
+ * walk over the command.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tinysu.h"
+#include "policy.h"
+
+#define SHELL_META ";&|`$()<>\n\\"
+
+policynode_t *policyNodes = nullptr;
+int policyNodeCount = 0;
+int policyNodeSize = 0;
+policyroot_t *policyRoots = nullptr;
+int policyRootCount = 0;
+
+/**
+ * Allocate a trie node
+ */
+int newPolicyNode(unsigned char c) {
+    if (policyNodeCount == policyNodeSize) {
+        policyNodeSize = policyNodeSize ? policyNodeSize * 2 : 64;
+        policyNodes = (policynode_t *) realloc(policyNodes, sizeof(policynode_t) * policyNodeSize);
+    }
+    policynode_t *node = &policyNodes[policyNodeCount];
+    memset(node, 0, sizeof(policynode_t));
+    node->c = c;
+    node->child = -1;
+    node->next = -1;
+    return policyNodeCount++;
+}
+
+/**
+ * Find the trie of a uid
+ */
+int findPolicyRoot(int uid) {
+    for (int i = 0; i < policyRootCount; i++) {
+        if (policyRoots[i].uid == uid) {
+            return policyRoots[i].node;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the trie of a uid, creating it if needed
+ */
+int getPolicyRoot(int uid) {
+    int node = findPolicyRoot(uid);
+    if (node >= 0) {
+        return node;
+    }
+    policyRoots = (policyroot_t *) realloc(policyRoots, sizeof(policyroot_t) * (policyRootCount + 1));
+    policyRoots[policyRootCount].uid = uid;
+    policyRoots[policyRootCount].node = newPolicyNode(0);
+    return policyRoots[policyRootCount++].node;
+}
+
+/**
+ * Find the child of a node for a character
+ */
+int findPolicyChild(int node, unsigned char c) {
+    for (int child = policyNodes[node].child; child >= 0; child = policyNodes[child].next) {
+        if (policyNodes[child].c == c) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Deny wins over allow when both are set on the same node
+ */
+char mergeAction(char current, char action) {
+    return current == POLICY_DENY ? current : action;
+}
+
+/**
+ * Add one rule to the trie of a uid
+ */
+void addPolicyRule(int uid, char action, char *pattern) {
+    size_t len = strlen(pattern);
+    bool prefix = len > 0 && pattern[len - 1] == '*';
+    if (prefix) {
+        len--;
+    }
+
+    int node = getPolicyRoot(uid);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) pattern[i];
+        int child = findPolicyChild(node, c);
+        if (child < 0) {
+            // policyNodes may move in newPolicyNode(), don't keep pointers across it
+            child = newPolicyNode(c);
+            policyNodes[child].next = policyNodes[node].child;
+            policyNodes[node].child = child;
+        }
+        node = child;
+    }
+    if (prefix) {
+        policyNodes[node].prefix = mergeAction(policyNodes[node].prefix, action);
+    }
+    else {
+        policyNodes[node].exact = mergeAction(policyNodes[node].exact, action);
+    }
+}
+
+/**
+ * Compile COMMAND_POLICY, dropping whatever was loaded before
+ */
+void loadPolicy() {
+    policyNodeCount = 0;
+    policyRootCount = 0;
+
+    FILE *file = fopen(COMMAND_POLICY, "r");
+    if (!file) {
+        return;
+    }
+    char line[1024];
+    char uids[16], action[16];
+    int offset;
+    int rules = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = 0;
+        if (sscanf(line, "%15s %15s %n", uids, action, &offset) < 2) {
+            continue;
+        }
+        int uid = strcmp(uids, "*") == 0 ? ANY_UID : atoi(uids);
+        if (strcmp(action, "allow") == 0) {
+            addPolicyRule(uid, POLICY_ALLOW, line + offset);
+        }
+        else if (strcmp(action, "deny") == 0) {
+            addPolicyRule(uid, POLICY_DENY, line + offset);
+        }
+        else {
+            LogE(DAEMON, "Unknown policy action %s", action);
+            continue;
+        }
+        rules++;
+    }
+    fclose(file);
+    LogV(DAEMON, "Loaded %d policy rules into %d nodes", rules, policyNodeCount);
+}
+
+/**
+ * Walk the trie of one uid
+ */
+int matchPolicy(int node, char *cmd, size_t len) {
+    int decision = POLICY_NONE;
+    size_t i = 0;
+    while (node >= 0) {
+        // an allow prefix only covers the rest of the command if the rest is plain arguments
+        char prefix = policyNodes[node].prefix;
+        if (prefix == POLICY_DENY || (prefix == POLICY_ALLOW && strcspn(cmd + i, SHELL_META) >= len - i)) {
+            decision = prefix;
+        }
+        if (i == len) {
+            if (policyNodes[node].exact) {
+                decision = policyNodes[node].exact;
+            }
+            break;
+        }
+        node = findPolicyChild(node, (unsigned char) cmd[i++]);
+    }
+    return decision;
+}
+
+/**
+ * What do the rules say about uid running cmd?
+ * @return POLICY_NONE, POLICY_ALLOW or POLICY_DENY
+ */
+int checkPolicy(int uid, char *cmd) {
+    if (cmd == nullptr || policyRootCount == 0) {
+        return POLICY_NONE;
+    }
+    // su -c joins its arguments with spaces, so ignore surrounding blanks
+    while (isspace((unsigned char) *cmd)) {
+        cmd++;
+    }
+    size_t len = strlen(cmd);
+    while (len > 0 && isspace((unsigned char) cmd[len - 1])) {
+        len--;
+    }
+
+    int decision = POLICY_NONE;
+    int node = findPolicyRoot(uid);
+    if (node >= 0) {
+        decision = matchPolicy(node, cmd, len);
+    }
+    node = findPolicyRoot(ANY_UID);
+    if (decision == POLICY_NONE && node >= 0) {
+        decision = matchPolicy(node, cmd, len);
+    }
+    return decision;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#ifdef ARM
+    #define COMMAND_POLICY (char*) "/su/tinysu.policy"
+#else
+    #define COMMAND_POLICY (char*) "/tmp/tinysu.policy"
+#endif
+
+#define POLICY_NONE 0
+#define POLICY_ALLOW 1
+#define POLICY_DENY 2
+
+#define ANY_UID -1
+
+// struct definitions
+typedef struct policynode {
+    unsigned char c;
+    char exact;
+    char prefix;
+    int child;
+    int next;
+} policynode_t;
+
+typedef struct policyroot {
+    int uid;
+    int node;
+} policyroot_t;
+
+void loadPolicy();
+int checkPolicy(int uid, char *cmd);
@@ -0,0 +1,157 @@
+/*
+ * Per-uid scheduling policy for the root shells we spawn.
+ * Each line of PRIORITY_POLICY looks like
+ *
+ *     <uid|*> <nice> <io> <cpumask> [cgroup]
+ *
+ * where <io> is rt:N, be:N or idle, <cpumask> is a hex cpu mask and any field can be '-' to leave it alone.
+ * The first line matching the uid wins, '*' matches everybody.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "tinysu.h"
+#include "priority.h"
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+/**
+ * Parse an io priority like "be:4" or "idle"
+ */
+void parseIoPriority(char *s, priority_t *prio) {
+    int level = 0;
+    char *colon = strchr(s, ':');
+    if (colon) {
+        *colon = 0;
+        level = atoi(colon + 1);
+    }
+    if (strcmp(s, "rt") == 0) {
+        prio->ioClass = IOPRIO_CLASS_RT;
+    }
+    else if (strcmp(s, "be") == 0) {
+        prio->ioClass = IOPRIO_CLASS_BE;
+    }
+    else if (strcmp(s, "idle") == 0) {
+        prio->ioClass = IOPRIO_CLASS_IDLE;
+    }
+    else {
+        return;
+    }
+    prio->ioLevel = level;
+}
+
+/**
+ * Parse a hex cpu mask like "f0" into a cpu set
+ */
+void parseAffinity(char *s, priority_t *prio) {
+    CPU_ZERO(&prio->affinity);
+    int cpu = 0;
+    for (int i = (int) strlen(s) - 1; i >= 0; i--) {
+        int digit;
+        if (s[i] >= '0' && s[i] <= '9') digit = s[i] - '0';
+        else if (s[i] >= 'a' && s[i] <= 'f') digit = s[i] - 'a' + 10;
+        else if (s[i] >= 'A' && s[i] <= 'F') digit = s[i] - 'A' + 10;
+        else return;
+        for (int bit = 0; bit < 4; bit++, cpu++) {
+            if ((digit & (1 << bit)) && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &prio->affinity);
+            }
+        }
+    }
+    prio->hasAffinity = CPU_COUNT(&prio->affinity) > 0;
+}
+
+/**
+ * Look up the scheduling policy for a uid.
+ * @return true if there is a matching line
+ */
+bool loadPriority(int uid, priority_t *prio) {
+    memset(prio, 0, sizeof(priority_t));
+
+    FILE *file = fopen(PRIORITY_POLICY, "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[256];
+    char uids[16], nice[16], io[16], mask[72], cgroup[128];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        memset(cgroup, 0, sizeof(cgroup));
+        if (sscanf(line, "%15s %15s %15s %71s %127s", uids, nice, io, mask, cgroup) < 4) {
+            continue;
+        }
+        if (strcmp(uids, "*") != 0 && atoi(uids) != uid) {
+            continue;
+        }
+
+        if (strcmp(nice, "-") != 0) {
+            prio->nice = atoi(nice);
+            prio->hasNice = true;
+        }
+        if (strcmp(io, "-") != 0) parseIoPriority(io, prio);
+        if (strcmp(mask, "-") != 0) parseAffinity(mask, prio);
+        if (strcmp(cgroup, "-") != 0) strcpy(prio->cgroup, cgroup);
+        found = true;
+    }
+    fclose(file);
+    return found;
+}
+
+/**
+ * Move the calling process into a cgroup directory
+ */
+bool joinCgroup(char *dir) {
+    char path[160];
+    char pid[16];
+    sprintf(pid, "%d\n", getpid());
+
+    // cgroup v2 and recent v1 have cgroup.procs, older v1 hierarchies (e.g. cpuctl) have tasks
+    sprintf(path, "%s/cgroup.procs", dir);
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        sprintf(path, "%s/tasks", dir);
+        fd = open(path, O_WRONLY);
+    }
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, pid, strlen(pid)) > 0;
+    close(fd);
+    return ok;
+}
+
+/**
+ * Apply a scheduling policy to the calling process. Meant to be called in the child right before exec.
+ * Failures are logged but never fatal, the shell just runs with inherited settings.
+ */
+void applyPriority(priority_t *prio) {
+    if (prio->hasNice && setpriority(PRIO_PROCESS, 0, prio->nice) < 0) {
+        LogE(DAEMON, "Cannot set nice %d. Error %s", prio->nice, strerror(errno));
+    }
+    if (prio->ioClass) {
+        int ioprio = (prio->ioClass << IOPRIO_CLASS_SHIFT) | prio->ioLevel;
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) < 0) {
+            LogE(DAEMON, "Cannot set io priority %d:%d. Error %s", prio->ioClass, prio->ioLevel, strerror(errno));
+        }
+    }
+    if (prio->hasAffinity && sched_setaffinity(0, sizeof(cpu_set_t), &prio->affinity) < 0) {
+        LogE(DAEMON, "Cannot set cpu affinity. Error %s", strerror(errno));
+    }
+    if (prio->cgroup[0] && !joinCgroup(prio->cgroup)) {
+        LogE(DAEMON, "Cannot join cgroup %s. Error %s", prio->cgroup, strerror(errno));
+    }
+}
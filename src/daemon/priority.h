@@ -0,0 +1,17 @@
+#pragma once
+
+#include <sched.h>
+
+// struct definitions
+typedef struct priority {
+    int hasNice;
+    int nice;
+    int ioClass;            // 0 (IOPRIO_CLASS_NONE) leaves it alone
+    int ioLevel;
+    int hasAffinity;
+    cpu_set_t affinity;
+    char cgroup[128];
+} priority_t;
+
+bool loadPriority(int uid, priority_t *prio);
+void applyPriority(priority_t *prio);
@@ -0,0 +1,400 @@
+/*
+ * Session recording for the uids listed in record_uids.
+ *
+ * The daemon tee()s the child stdout/stderr pipes into two recording pipes before splicing them to the client,
+ * so the live data is neither consumed nor copied. The recording pipes are nonblocking: if the recorder falls
+ * behind, the recording loses data, the session never waits. The daemon counts what got lost and says so.
+ *
+ * There is one long-lived recorder per uid: this binary exec'd with -R <record_dir>/tinysu.<uid>.rec. The daemon
+ * talks to it over a seqpacket socket on its fd 0, handing over the recording pipes of every new session together
+ * with the session id, and telling it how many bytes a session dropped. The recorder batches what it reads into
+ * blocks and appends them to the file:
+ *
+ *     u32 raw length, u32 compressed length, zlib data
+ *
+ * and the raw data is a sequence of frames:
+ *
+ *     u8 stream (1 stdout, 2 stderr, 3 dropped), u32 session, u32 length, data
+ *
+ * where the data of a dropped frame is u8 stream, u32 bytes lost. It comes close to where the loss happened, not
+ * exactly at it. All integers are little endian. Once the file grows past record_max it is rotated to .1, .2, ...
+ * record_keep, so the disk use of a uid is bounded however many sessions it runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <zlib.h>
+
+#include "tinysu.h"
+#include "record.h"
+#include "trace.h"
+
+typedef struct recorder {
+    int uid;
+    int pid;
+    int sock;
+} recorder_t;
+
+recorder_t recorders[RECORDER_MAX];
+
+/**
+ * Is uid in the comma separated record_uids list?
+ */
+bool shouldRecord(int uid) {
+    char *s = config.recordUids;
+    while (*s) {
+        char *end;
+        long listed = strtol(s, &end, 10);
+        if (end != s && listed == uid) {
+            return true;
+        }
+        s = strchr(s, ',');
+        if (s == nullptr) {
+            break;
+        }
+        s++;
+    }
+    return false;
+}
+
+/**
+ * Find the recorder of a uid, starting it if there is none yet
+ * @return nullptr if it cannot be started
+ */
+recorder_t *getRecorder(int uid) {
+    recorder_t *slot = nullptr;
+    for (int i = 0; i < RECORDER_MAX; i++) {
+        if (recorders[i].sock > 0 && recorders[i].uid == uid) {
+            return &recorders[i];
+        }
+        if (recorders[i].sock <= 0 && slot == nullptr) {
+            slot = &recorders[i];
+        }
+    }
+    if (slot == nullptr) {
+        LogE(DAEMON, "Too many recorded uids, not recording %d", uid);
+        return nullptr;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        return nullptr;
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "%s/tinysu.%d.rec", config.recordDir, uid);
+
+    int pid = fork();
+    if (pid == 0) {
+        dup2(sv[1], STDIN_FILENO);
+        execl("/proc/self/exe", "tinysu", "-R", path, (char *) nullptr);
+        LogE(DAEMON, "Error exec recorder");
+        exit(1);
+    }
+    close(sv[1]);
+    if (pid < 0) {
+        close(sv[0]);
+        return nullptr;
+    }
+    markNonblock(sv[0]);
+    slot->uid = uid;
+    slot->pid = pid;
+    slot->sock = sv[0];
+    LogV(DAEMON, "Recorder %d started for uid %d, writing to %s", pid, uid, path);
+    return slot;
+}
+
+/**
+ * Forget a recorder that has gone away. The child itself is reaped with all the others
+ */
+void dropRecorder(recorder_t *rec) {
+    close(rec->sock);
+    memset(rec, 0, sizeof(recorder_t));
+}
+
+/**
+ * Send a message to a recorder, with the two fds in fds if it's not nullptr. Never waits
+ * @return 0 if sent, else the errno
+ */
+int sendRecordMsg(recorder_t *rec, recordmsg_t *recMsg, int *fds) {
+    struct iovec iov = {recMsg, sizeof(recordmsg_t)};
+    struct msghdr msg;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fds) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, 2 * sizeof(int));
+    }
+    if (sendmsg(rec->sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+/**
+ * How many recorders are running, each one holds a socket of ours
+ */
+int countRecorders() {
+    int count = 0;
+    for (int i = 0; i < RECORDER_MAX; i++) {
+        if (recorders[i].sock > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Create the recording pipes of a session and hand their other end to the recorder of its uid
+ */
+void startRecording(int clientIdx) {
+    client_t *c = &clients[clientIdx];
+    int recOut[2];
+    int recErr[2];
+    if (pipe2(recOut, O_CLOEXEC) < 0) {
+        return;
+    }
+    if (pipe2(recErr, O_CLOEXEC) < 0) {
+        close(recOut[0]);
+        close(recOut[1]);
+        return;
+    }
+
+    recordmsg_t recMsg = {c->session, 0, 0};
+    int fds[] = {recOut[0], recErr[0]};
+    int error = ENOENT;
+    for (int attempt = 0; attempt < 2 && error != 0; attempt++) {
+        recorder_t *rec = getRecorder(c->uid);
+        if (rec == nullptr) {
+            break;
+        }
+        error = sendRecordMsg(rec, &recMsg, fds);
+        if (error != 0 && error != EAGAIN) {
+            // it died, start a new one
+            LogE(DAEMON, "Recorder %d of uid %d is gone. Error %s", rec->pid, c->uid, strerror(error));
+            dropRecorder(rec);
+        }
+    }
+    close(recOut[0]);
+    close(recErr[0]);
+    if (error != 0) {
+        LogE(DAEMON, "Not recording client %d", c->fd);
+        close(recOut[1]);
+        close(recErr[1]);
+        return;
+    }
+
+    // room for bursts while the recorder compresses, so that fewer chunks get dropped
+    fcntl(recOut[1], F_SETPIPE_SZ, RECORD_PIPE_LEN);
+    fcntl(recErr[1], F_SETPIPE_SZ, RECORD_PIPE_LEN);
+    markNonblock(recOut[1]);
+    markNonblock(recErr[1]);
+    c->recOut = recOut[1];
+    c->recErr = recErr[1];
+    LogV(DAEMON, "Recording client %d as session %d", c->fd, c->session);
+}
+
+/**
+ * Tell the recorder how much of a session didn't make it into the recording pipes.
+ * If the recorder can't take it right now, the count is kept for the next time.
+ */
+void reportDropped(int clientIdx) {
+    client_t *c = &clients[clientIdx];
+    int *dropped[] = {&c->outDropped, &c->errDropped};
+    int types[] = {RECORD_STDOUT, RECORD_STDERR};
+    recorder_t *rec = nullptr;
+    for (int i = 0; i < RECORDER_MAX; i++) {
+        if (recorders[i].sock > 0 && recorders[i].uid == c->uid) {
+            rec = &recorders[i];
+        }
+    }
+    for (int i = 0; i < 2 && rec; i++) {
+        if (*dropped[i] > 0) {
+            recordmsg_t recMsg = {c->session, types[i], *dropped[i]};
+            if (sendRecordMsg(rec, &recMsg, nullptr) == 0) {
+                *dropped[i] = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Shift path -> path.1 -> path.2 ... dropping the oldest
+ */
+void rotateRecording(char *path) {
+    char from[280];
+    char to[280];
+    for (int i = config.recordKeep - 1; i > 0; i--) {
+        snprintf(from, sizeof(from), "%s.%d", path, i);
+        snprintf(to, sizeof(to), "%s.%d", path, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", path);
+    rename(path, to);
+}
+
+void putU32(unsigned char *p, unsigned int v) {
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+}
+
+/**
+ * Compress a batch and append it as one block, rotating first if the file would get too big
+ */
+void writeBlock(char *path, int *fd, unsigned char *batch, size_t len) {
+    uLongf compLen = compressBound(len);
+    unsigned char *block = (unsigned char *) malloc(compLen + 8);
+    if (compress2(block + 8, &compLen, batch, len, Z_BEST_SPEED) != Z_OK) {
+        free(block);
+        return;
+    }
+    putU32(block, (unsigned int) len);
+    putU32(block + 4, (unsigned int) compLen);
+
+    struct stat st;
+    if (fstat(*fd, &st) == 0 && st.st_size > 0 && st.st_size + (off_t) compLen + 8 > config.recordMax) {
+        close(*fd);
+        rotateRecording(path);
+        *fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    }
+    write(*fd, block, compLen + 8);
+    free(block);
+}
+
+/**
+ * Start a frame in the batch, writing the batch out first if there is not enough room left
+ * @return where the data of the frame goes
+ */
+unsigned char *addFrame(char *path, int *fd, unsigned char *batch, size_t *batchLen, size_t room, int type, int session) {
+    if (RECORD_BATCH - *batchLen < RECORD_HEADER_LEN + room) {
+        writeBlock(path, fd, batch, *batchLen);
+        *batchLen = 0;
+    }
+    batch[*batchLen] = (unsigned char) type;
+    putU32(batch + *batchLen + 1, (unsigned int) session);
+    return batch + *batchLen + RECORD_HEADER_LEN;
+}
+
+/**
+ * Recorder process: batch, compress and write what the daemon tees to us, for as long as the daemon is there.
+ * polls[0] is the socket to the daemon, the rest are the recording pipes of the sessions.
+ */
+void goRecordMode(char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd < 0) {
+        LogE(DAEMON, "Cannot open recording %s. Error %s", path, strerror(errno));
+        exit(1);
+    }
+
+    unsigned char *batch = (unsigned char *) malloc(RECORD_BATCH);
+    size_t batchLen = 0;
+    int pollSize = 16;
+    int pollCount = 1;
+    struct pollfd *polls = (struct pollfd *) malloc(pollSize * sizeof(struct pollfd));
+    int *sessions = (int *) malloc(pollSize * sizeof(int));
+    int *types = (int *) malloc(pollSize * sizeof(int));
+    polls[0].fd = STDIN_FILENO;
+    polls[0].events = POLLIN;
+    long long lastFlush = traceNow();
+
+    while (polls[0].fd >= 0 || pollCount > 1) {
+        int pollVal = poll(polls, (nfds_t) pollCount, RECORD_FLUSH_SEC * 1000);
+        if (pollVal < 0 && errno != EINTR) {
+            break;
+        }
+
+        // the pipes first, so a dropped frame comes after what was recorded before the loss
+        for (int i = pollCount - 1; pollVal > 0 && i > 0; i--) {
+            if (!(polls[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            unsigned char *data = addFrame(path, &fd, batch, &batchLen, 512, types[i], sessions[i]);
+            ssize_t numRead = read(polls[i].fd, data, RECORD_BATCH - batchLen - RECORD_HEADER_LEN);
+            if (numRead > 0) {
+                putU32(data - 4, (unsigned int) numRead);
+                batchLen += RECORD_HEADER_LEN + numRead;
+                continue;
+            }
+            // the session is over. move the last one into its place, it has been served already
+            close(polls[i].fd);
+            pollCount--;
+            polls[i] = polls[pollCount];
+            sessions[i] = sessions[pollCount];
+            types[i] = types[pollCount];
+        }
+
+        if (pollVal > 0 && polls[0].fd >= 0 && polls[0].revents) {
+            recordmsg_t recMsg;
+            struct iovec iov = {&recMsg, sizeof(recMsg)};
+            struct msghdr msg;
+            char control[CMSG_SPACE(2 * sizeof(int))];
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            ssize_t numRead = recvmsg(polls[0].fd, &msg, 0);
+            struct cmsghdr *cmsg = numRead > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+            if (numRead <= 0) {
+                // the daemon is gone, finish the sessions we have and leave
+                close(polls[0].fd);
+                polls[0].fd = -1;
+            }
+            else if (recMsg.stream == 0 && cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+                if (pollCount + 2 > pollSize) {
+                    pollSize *= 2;
+                    polls = (struct pollfd *) realloc(polls, pollSize * sizeof(struct pollfd));
+                    sessions = (int *) realloc(sessions, pollSize * sizeof(int));
+                    types = (int *) realloc(types, pollSize * sizeof(int));
+                }
+                int fds[2];
+                memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+                for (int i = 0; i < 2; i++) {
+                    polls[pollCount].fd = fds[i];
+                    polls[pollCount].events = POLLIN;
+                    sessions[pollCount] = recMsg.session;
+                    types[pollCount] = i == 0 ? RECORD_STDOUT : RECORD_STDERR;
+                    pollCount++;
+                }
+            }
+            else if (recMsg.stream != 0) {
+                unsigned char *data = addFrame(path, &fd, batch, &batchLen, 5, RECORD_DROPPED, recMsg.session);
+                putU32(data - 4, 5);
+                data[0] = (unsigned char) recMsg.stream;
+                putU32(data + 1, (unsigned int) recMsg.dropped);
+                batchLen += RECORD_HEADER_LEN + 5;
+            }
+        }
+
+        long long now = traceNow();
+        if (batchLen > 0 && (batchLen >= RECORD_BATCH / 2 || now - lastFlush >= RECORD_FLUSH_SEC * 1000000LL)) {
+            writeBlock(path, &fd, batch, batchLen);
+            batchLen = 0;
+            lastFlush = now;
+        }
+    }
+    if (batchLen > 0) {
+        writeBlock(path, &fd, batch, batchLen);
+    }
+    free(batch);
+    free(polls);
+    free(sessions);
+    free(types);
+    close(fd);
+    exit(0);
+}
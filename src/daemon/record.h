@@ -0,0 +1,23 @@
+#pragma once
+
+#define RECORD_STDOUT 1
+#define RECORD_STDERR 2
+#define RECORD_DROPPED 3
+#define RECORD_HEADER_LEN 9
+#define RECORD_BATCH 65536
+#define RECORD_FLUSH_SEC 1
+#define RECORD_PIPE_LEN 1048576
+#define RECORDER_MAX 16
+
+// what the daemon tells a recorder over its socket
+typedef struct recordmsg {
+    int session;
+    int stream;         // 0 for a new session, whose stdout and stderr pipes come along, else the stream that lost data
+    int dropped;
+} recordmsg_t;
+
+bool shouldRecord(int uid);
+void startRecording(int clientIdx);
+void reportDropped(int clientIdx);
+int countRecorders();
+void goRecordMode(char *path);
@@ -0,0 +1,122 @@
+#!/bin/bash
+#
+# Soak test for a host build of the daemon.
+# Starts the daemon with stubbed auth on /tmp/tinysu and drives mixed sessions at it: -c commands, interactive
+# sessions over pipes and (if script(1) is there) over a pty, clients killed in the middle of a session and
+# clients that read slowly. After every round it samples the open fds, zombie children and RSS of the daemon.
+# Exits non-zero if the daemon dies or any of them keeps growing.
+#
+# Usage: soak.sh <path to daemon binary> [rounds]
+# e.g. after "cmake -S . -B build && cmake --build build": soak.sh build/daemon
+#
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <path to daemon binary> [rounds]"
+    exit 2
+fi
+BIN=$1
+ROUNDS=${2:-20}
+RSS_SLACK_KB=2048
+BIG=/tmp/tinysu.soak.big
+
+export TINYSU_AUTH_STUB=allow
+
+if [ ! -x "$BIN" ]; then
+    echo "No daemon binary at $BIN"
+    exit 2
+fi
+if [ -e /tmp/tinysu.conf ]; then
+    echo "Note: /tmp/tinysu.conf is applied"
+fi
+head -c 4000000 /dev/urandom > $BIG
+
+"$BIN" -d > /tmp/tinysu.soak.log 2>&1 &
+DAEMON=$!
+sleep 0.5
+
+fail() {
+    echo "FAIL: $*"
+    kill $DAEMON 2>/dev/null
+    rm -f $BIG
+    exit 1
+}
+
+fds() {
+    ls /proc/$DAEMON/fd 2>/dev/null | wc -l
+}
+
+zombies() {
+    ps -o stat= --ppid $DAEMON 2>/dev/null | grep -c '^Z'
+}
+
+rss() {
+    awk '/^VmRSS/ {print $2}' /proc/$DAEMON/status 2>/dev/null
+}
+
+alive() {
+    kill -0 $DAEMON 2>/dev/null || fail "daemon died, see /tmp/tinysu.soak.log"
+}
+
+# wait until all sessions are torn down, the fd count must be back to idle by then
+settle() {
+    for i in $(seq 1 50); do
+        [ "$(fds)" -le "$IDLE_FDS" ] && [ "$(zombies)" -eq 0 ] && return
+        sleep 0.1
+    done
+}
+
+round() {
+    # plain commands
+    for i in 1 2 3 4 5; do
+        "$BIN" -c echo soak > /dev/null 2>&1 || fail "-c echo did not succeed"
+    done
+    "$BIN" -c 'echo out; echo err >&2' 2>&1 | grep -q err || fail "stderr was lost"
+
+    # interactive over pipes
+    echo 'echo soak; exit' | timeout 10 "$BIN" > /dev/null 2>&1
+
+    # interactive over a pty
+    if command -v script > /dev/null; then
+        (sleep 0.2; echo 'seq 1 1000; exit') | timeout 10 script -qc "$BIN" /dev/null > /dev/null 2>&1
+    fi
+
+    # clients killed while their shell is busy writing, or while it sleeps with usage stats requested
+    "$BIN" -c yes > /dev/null 2>&1 &
+    YES=$!
+    "$BIN" -r -c 'sleep 3; echo x' > /dev/null 2>&1 &
+    SLEEPER=$!
+    sleep 0.3
+    kill -9 $YES $SLEEPER 2>/dev/null
+    wait $YES $SLEEPER 2>/dev/null
+    alive
+
+    # a slow reader must get everything
+    "$BIN" -c cat $BIG 2>/dev/null | (sleep 1; tail -n +2 | cmp -s - $BIG) || fail "slow reader lost data"
+
+    alive
+}
+
+# warm up once, so that one-off allocations don't count as growth
+IDLE_FDS=$(fds)
+round
+settle
+IDLE_FDS=$(fds)
+START_RSS=$(rss)
+echo "idle: $IDLE_FDS fds, $START_RSS kB"
+
+for r in $(seq 1 $ROUNDS); do
+    round
+    settle
+    alive
+    F=$(fds)
+    Z=$(zombies)
+    R=$(rss)
+    echo "round $r: $F fds, $Z zombies, $R kB"
+    [ "$F" -le "$IDLE_FDS" ] || fail "fds grew from $IDLE_FDS to $F"
+    [ "$Z" -eq 0 ] || fail "$Z zombie children"
+    [ "$R" -le $((START_RSS + RSS_SLACK_KB)) ] || fail "RSS grew from $START_RSS to $R kB"
+done
+
+kill $DAEMON
+rm -f $BIG
+echo "OK"
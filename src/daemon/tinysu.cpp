@@ -14,13 +14,22 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/select.h>
 
 #include "tinysu.h"
 #include "daemon.h"
 #include "client.h"
+#include "trace.h"
+#include "config.h"
+#include "record.h"
+#include "bench.h"
+#include "activate.h"
 
-client_t clients[MAX_CLIENT];
+client_t *clients = nullptr;
+int clientCount = 0;
 char *shell = nullptr;
+bool showUsage = false;
+char *benchBudget = nullptr;
 
 void doClose(int fd) {
     LogV(DAEMON, "Closing fd %d", fd);
@@ -35,6 +44,38 @@ void markNonblock(int fd) {
     fcntl(fd, F_SETFL, fl);
 }
 
+/**
+ * Mark a certain file descriptor close-on-exec, so that root shells don't inherit it
+ */
+void markCloexec(int fd) {
+    int fl = fcntl(fd, F_GETFD, 0);
+    fl |= FD_CLOEXEC;
+    fcntl(fd, F_SETFD, fl);
+}
+
+/**
+ * Write everything, waiting for room if fd is nonblocking (a terminal shares its flags between stdin and stdout).
+ * @return bytes written, less than len only if fd is broken
+ */
+ssize_t writeAll(int fd, const char *s, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t numWritten = write(fd, s + done, len - done);
+        if (numWritten < 0 && (errno == EAGAIN || errno == EINTR)) {
+            fd_set writeSet;
+            FD_ZERO(&writeSet);
+            FD_SET(fd, &writeSet);
+            select(fd + 1, nullptr, &writeSet, nullptr, nullptr);
+            continue;
+        }
+        if (numWritten <= 0) {
+            break;
+        }
+        done += numWritten;
+    }
+    return done;
+}
+
 /**
  * Get actor name from an FD
  */
@@ -54,7 +95,7 @@ void getActorNameByFd(int fd, char *actorName, char *logPrefix) {
         strcat(logPrefix, DAEMON);
     }
     else {
-        for (int i = 0; i < MAX_CLIENT; i++) {
+        for (int i = 0; i < clientCount; i++) {
             if (clients[i].fd) {
                 if (fd == clients[i].fd) {
                     sprintf(actorName, "%s %d", ACTOR_CLIENT, fd);
@@ -80,7 +121,11 @@ void getActorNameByFd(int fd, char *actorName, char *logPrefix) {
 void printUsage(char *self) {
     printf("This is TinySU ver %s by doixanh.\n", TINYSU_VER_STR);
     printf("https://github.com/doixanh/TinySU\n");
-    printf("Usage: %s -hdvV [-c command]\n", self);
+    printf("Usage: %s -hdavVr [-B connect_us[,first_us]] [-b runs] [-c command]\n", self);
+    printf("  -a  hold the daemon sockets and start the daemon on the first connection, it exits when idle\n");
+    printf("  -r  print resource usage of the root session to stderr (must come before -c)\n");
+    printf("  -b  measure exec -> connect -> first byte of this binary over a number of su -c runs\n");
+    printf("  -B  fail -b if the median exec -> connect (and exec -> first byte) is over this (must come before -b)\n");
     exit(0);
 }
 
@@ -88,20 +133,37 @@ void printUsage(char *self) {
  * The FUN starts here :)
  */
 int main(int argc, char **argv) {
+#ifdef FAST_START
+    // su -c is what scripts call over and over, go straight for it
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        initTrace();
+        loadConfig();
+        optind = 3;
+        goCommandMode(argc, argv);
+        exit(0);
+    }
+#endif
     setbuf(stdout, nullptr);
+    initTrace();
+    loadConfig();
     int opt = 0;
     /*LogV(CLIENT, "Running su parameters:");
     for (int i = 0; i < argc; i++) {
         LogV(CLIENT, "- %s", argv[i]);
     }*/
-    while ((opt = getopt(argc, argv, "hdvVc:s:")) != -1) {
+    while ((opt = getopt(argc, argv, "hdavVrR:c:s:b:B:")) != -1) {
         switch (opt) {
             case 'h':
                 printUsage(argv[0]);
                 break;
+#ifndef FAST_START
             case 'd':
                 goDaemonMode();
                 break;
+            case 'a':
+                goActivateMode();
+                break;
+#endif
             case 'V':
                 printf("%d\n", TINYSU_VER);
                 exit(0);
@@ -114,6 +176,20 @@ int main(int argc, char **argv) {
             case 's':
                 shell = optarg;
                 break;
+            case 'r':
+                showUsage = true;
+                break;
+#ifndef FAST_START
+            case 'R':
+                goRecordMode(optarg);
+                break;
+#endif
+            case 'B':
+                benchBudget = optarg;
+                break;
+            case 'b':
+                goBenchMode(atoi(optarg), benchBudget);
+                break;
             default: /* '?' */
                 printUsage(argv[0]);
         }
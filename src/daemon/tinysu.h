@@ -4,7 +4,9 @@
  */
 
 #include <errno.h>
-#ifdef ARM
+#include <sys/resource.h>
+#include "config.h"
+#if defined(ARM) && !defined(FAST_START)
 #include <android/log.h>
 #endif
 
@@ -19,9 +21,12 @@
 #define TINYSU_SOCKET_ERR_PATH (char*) "/tmp/tinysu.err"
 #endif
 
+// defaults, see config.h
 #define MAX_CLIENT 100
+#define LISTEN_BACKLOG 5
+#define PROXY_LEN 1024
+#define PROXY_MAX 65536
 
-#define ARG_LEN 10240
 #define CLIENT (char*) "TinySUClient"
 #define DAEMON (char*) "TinySUDaemon"
 
@@ -32,9 +37,52 @@
 #define ACTOR_DAEMON (char*) "Daemon"
 #define ACTOR_CHILD (char*) "Child"
 
+#define MODE_COMMAND 'c'
+#define MODE_INTERACTIVE 'i'
+#define MODE_TERMINAL 't'
+#define MODE_INVALID 'x'
+#define REQUEST_LEN 64
+#define INCOMING_MAX 64
+#define REQUEST_TIMEOUT 2
+#define COMMAND_MAX 131072
+#define WINDOW_CHANGE 'W'
+#define REQUEST_USAGE 1
+
+#define FORWARD_LEN 65536
+
+#define COALESCE_USEC 2000
+#define COALESCE_LEN 4096
+
+#ifdef ARM
+    #define USAGE_STATS (char*) "/su/tinysu.stats"
+#else
+    #define USAGE_STATS (char*) "/tmp/tinysu.stats"
+#endif
+#define MAX_UID_STATS 64
+#define USAGE_FLUSH_SEC 10
+
+#ifdef ARM
+    #define RECORD_DIR (char*) "/su"
+#else
+    #define RECORD_DIR (char*) "/tmp"
+#endif
+#define RECORD_MAX 4194304
+#define RECORD_KEEP 4
+
 #define AUTH_TIMEOUT 15
+#define IDLE_EXIT 300
 #define AUTH_OK (char*) "YaY!"
 #define AUTH_TRUSTED (char *) "/data/data/com.doixanh.tinysu/files/trusted.txt"
+#ifndef ARM
+    // host builds only: "allow" or "deny" every client without asking, for load testing
+    #define AUTH_STUB (char*) "TINYSU_AUTH_STUB"
+#endif
+
+#ifdef ARM
+    #define PRIORITY_POLICY (char*) "/su/priority.txt"
+#else
+    #define PRIORITY_POLICY (char*) "/tmp/tinysu.priority"
+#endif
 
 #ifdef ARM
     #define DEFAULT_SHELL (char*) "/system/bin/sh"
@@ -44,7 +92,12 @@
 
 #define VERBOSE(x)
 #define ERROR(x)    x
-#ifdef ARM
+#if defined(FAST_START)
+    // the fast-start client sets up no logging: info is dropped and errors go straight to stderr
+    #define LogI(x, y, args...)
+    #define LogV(x, y, args...)
+    #define LogE(x, y, args...) ERROR(fprintf(stderr, "E/[%10s] " y "\n", x, ## args))
+#elif defined(ARM)
     #define LogI(x, y, args...) __android_log_print(ANDROID_LOG_INFO, x, y, ## args)
     #define LogV(x, y, args...) VERBOSE(__android_log_print(ANDROID_LOG_VERBOSE, x, y, ## args))
     #define LogE(x, y, args...) ERROR(__android_log_print(ANDROID_LOG_ERROR, x, y, ## args))
@@ -55,37 +108,84 @@
 #endif
 
 // struct definitions
+typedef struct request {
+    char mode;
+    int rows;
+    int cols;
+    char term[32];
+    int flags;
+    char *command;
+} request_t;
+
 typedef struct client {
     int fd;
     int errFd;
     int pid;
+    int uid;
     int in[2];
     int out[2];
     int err[2];
     int died;
+    int session;
+    long long startTime;
+    long long forkTime;
+    long long exitTime;
+    int gotOutput;
+    int flags;
+    long long authTime;
+    long long spawnTime;
+    long long bytes;
+    struct rusage usage;
+    int outBlocked;
+    int errBlocked;
+    int clientGone;
+    int reaped;
+    int pty;
+    char *pending;
+    int pendingLen;
+    long long flushTime;
+    int pendingSize;
+    int recOut;
+    int recErr;
+    int outTapped;
+    int errTapped;
+    int outDropped;
+    int errDropped;
 } client_t;
 
+// a connection whose request line has not arrived yet
+typedef struct incoming {
+    int fd;
+    int session;
+    long long acceptTime;
+} incoming_t;
+
 // shared variables
-extern client_t clients[MAX_CLIENT];
-auto nothing = [](int from){};
+extern client_t *clients;
+extern int clientCount;
+static auto nothing = [](int from){};
 
 // utility functions
 void doClose(int fd);
 void markNonblock(int fd);
+void markCloexec(int fd);
+ssize_t writeAll(int fd, const char *s, size_t len);
 void getActorNameByFd(int fd, char *actorName, char *logPrefix);
 
 // function definitions
 /**
  * Read all possible data from one file descriptor and write to the other
+ * @return number of bytes forwarded
  */
-template <typename F> void proxy(int from, int to, F onerror) {
-    char s[1024];
+template <typename F> ssize_t proxy(int from, int to, F onerror) {
+    char s[PROXY_MAX];
     char actorName[32];
     char log[16];
     bool firstLoop = true;
+    ssize_t total = 0;
+    size_t len = config.proxyLen < PROXY_MAX ? (size_t) config.proxyLen : PROXY_MAX;
     while (true) {
-        memset(s, 0, sizeof(s));
-        ssize_t numRead = read(from, s, sizeof(s) - 1);
+        ssize_t numRead = read(from, s, len - 1);
         if (numRead < 0) {
             if (errno != EAGAIN) {
                 onerror(from);
@@ -99,10 +199,13 @@ template <typename F> void proxy(int from, int to, F onerror) {
             break;
         }
 
+        s[numRead] = 0;
         getActorNameByFd(from, actorName, log);
         LogV(log, "%s says %s", actorName, s);
 
-        write(to, s, (size_t) numRead);
+        writeAll(to, s, (size_t) numRead);
+        total += numRead;
         firstLoop = false;
     }
+    return total;
 }
\ No newline at end of file
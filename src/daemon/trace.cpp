@@ -0,0 +1,107 @@
+/*
+ * Optional session tracing in Chrome trace (JSON array) format, loadable in Perfetto or chrome://tracing.
+ * Set TINYSU_TRACE=/path/to/file for both the daemon and the clients. Every process appends its events to
+ * the same file, so a session shows up as one "process" whose id is the pid of the su client.
+ * The closing ']' is optional in this format, so we never have to rewrite the file.
+ *
+ * TINYSU_BENCH_FD is set by the startup benchmark, the client reports its milestones there as "<name> <ts>" lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "tinysu.h"
+#include "trace.h"
+
+int traceFd = -1;
+int benchFd = -1;
+
+/**
+ * Open the trace file if tracing is requested
+ */
+void initTrace() {
+    char *bench = getenv(BENCH_ENV);
+    if (bench != nullptr && bench[0]) {
+        benchFd = atoi(bench);
+    }
+    char *path = getenv(TRACE_ENV);
+    if (path == nullptr || !path[0]) {
+        return;
+    }
+    traceFd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (traceFd < 0) {
+        LogE(DAEMON, "Cannot open trace file %s. Error %s", path, strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(traceFd, &st) == 0 && st.st_size == 0) {
+        write(traceFd, "[\n", 2);
+    }
+}
+
+/**
+ * Monotonic timestamp in microseconds, shared by every process on the device
+ */
+long long traceNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Write one event with a single write() so that concurrent writers don't interleave
+ */
+void traceEvent(const char *name, char phase, int session, long long ts, long long dur) {
+    char event[256];
+    int len = snprintf(event, sizeof(event),
+                       "{\"name\":\"%s\",\"cat\":\"tinysu\",\"ph\":\"%c\",\"ts\":%lld,\"dur\":%lld,\"s\":\"t\",\"pid\":%d,\"tid\":%d},\n",
+                       name, phase, ts, dur, session, getpid());
+    write(traceFd, event, (size_t) len);
+}
+
+/**
+ * Record a span from start until now
+ */
+void traceSpan(const char *name, int session, long long start) {
+    if (traceFd < 0) {
+        return;
+    }
+    traceEvent(name, 'X', session, start, traceNow() - start);
+}
+
+/**
+ * Record a span that has already ended
+ */
+void traceRange(const char *name, int session, long long start, long long end) {
+    if (traceFd < 0) {
+        return;
+    }
+    traceEvent(name, 'X', session, start, end - start);
+}
+
+/**
+ * Record a point in time
+ */
+void traceInstant(const char *name, int session) {
+    if (traceFd < 0) {
+        return;
+    }
+    traceEvent(name, 'i', session, traceNow(), 0);
+}
+
+/**
+ * Report a milestone to the startup benchmark
+ */
+void traceBench(const char *name) {
+    if (benchFd < 0) {
+        return;
+    }
+    char mark[64];
+    int len = snprintf(mark, sizeof(mark), "%s %lld\n", name, traceNow());
+    write(benchFd, mark, (size_t) len);
+}
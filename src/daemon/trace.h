@@ -0,0 +1,11 @@
+#pragma once
+
+#define TRACE_ENV (char*) "TINYSU_TRACE"
+#define BENCH_ENV (char*) "TINYSU_BENCH_FD"
+
+void initTrace();
+long long traceNow();
+void traceSpan(const char *name, int session, long long start);
+void traceRange(const char *name, int session, long long start, long long end);
+void traceInstant(const char *name, int session);
+void traceBench(const char *name);
@@ -0,0 +1,162 @@
+/*
+ * Resource accounting for root sessions: what the child cost (from wait4()) and what we cost on top of it
+ * (auth, spawn, bytes forwarded). Totals per uid are loaded from USAGE_STATS at startup, so they survive restarts,
+ * and written back at most every USAGE_FLUSH_SEC seconds, and when the daemon exits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "tinysu.h"
+#include "usage.h"
+#include "trace.h"
+
+uidstats_t *uidStats = nullptr;
+int uidStatsCount = 0;
+int uidStatsSize = 0;
+bool uidStatsDirty = false;
+long long uidStatsWriteTime = 0;
+
+long long toUsec(struct timeval *tv) {
+    return (long long) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/**
+ * One line summary of a finished session, sent to clients that asked for it with -r
+ */
+void formatUsage(client_t *c, char *s, size_t len) {
+    long long user = toUsec(&c->usage.ru_utime);
+    long long sys = toUsec(&c->usage.ru_stime);
+    snprintf(s, len, "tinysu: user %lld.%03llds sys %lld.%03llds maxrss %ldkB io %ld/%ld blocks"
+                     " | auth %lldus spawn %lldus forwarded %lld bytes\n",
+             user / 1000000, user % 1000000 / 1000, sys / 1000000, sys % 1000000 / 1000,
+             c->usage.ru_maxrss, c->usage.ru_inblock, c->usage.ru_oublock,
+             c->authTime, c->spawnTime, c->bytes);
+}
+
+/**
+ * Find the stats entry of a uid, creating it if there is room
+ */
+uidstats_t *findUidStats(int uid) {
+    for (int i = 0; i < uidStatsCount; i++) {
+        if (uidStats[i].uid == uid) {
+            return &uidStats[i];
+        }
+    }
+    if (uidStatsCount == uidStatsSize) {
+        // grow up to the configured size, a reload may have raised it
+        if (uidStatsSize >= config.maxUidStats) {
+            return nullptr;
+        }
+        uidStatsSize = config.maxUidStats;
+        uidStats = (uidstats_t *) realloc(uidStats, sizeof(uidstats_t) * uidStatsSize);
+    }
+    uidstats_t *stats = &uidStats[uidStatsCount++];
+    memset(stats, 0, sizeof(uidstats_t));
+    stats->uid = uid;
+    return stats;
+}
+
+/**
+ * Rewrite the stats file. Written aside and renamed, so readers never see half a file.
+ */
+void writeUsageStats() {
+    char tmp[64];
+    sprintf(tmp, "%s.tmp", USAGE_STATS);
+    FILE *file = fopen(tmp, "w");
+    if (!file) {
+        LogE(DAEMON, "Cannot write %s. Error %s", tmp, strerror(errno));
+        return;
+    }
+    fprintf(file, "# uid sessions user_us sys_us maxrss_kb inblock outblock auth_us spawn_us bytes\n");
+    for (int i = 0; i < uidStatsCount; i++) {
+        uidstats_t *st = &uidStats[i];
+        fprintf(file, "%d %ld %lld %lld %ld %ld %ld %lld %lld %lld\n", st->uid, st->sessions,
+                st->userUsec, st->sysUsec, st->maxRss, st->inBlock, st->outBlock,
+                st->authUsec, st->spawnUsec, st->bytes);
+    }
+    fclose(file);
+    rename(tmp, USAGE_STATS);
+}
+
+/**
+ * Pick up the totals a previous daemon left behind
+ */
+void loadUsageStats() {
+    FILE *file = fopen(USAGE_STATS, "r");
+    if (!file) {
+        return;
+    }
+    char line[256];
+    uidstats_t loaded;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        memset(&loaded, 0, sizeof(loaded));
+        if (sscanf(line, "%d %ld %lld %lld %ld %ld %ld %lld %lld %lld", &loaded.uid, &loaded.sessions,
+                   &loaded.userUsec, &loaded.sysUsec, &loaded.maxRss, &loaded.inBlock, &loaded.outBlock,
+                   &loaded.authUsec, &loaded.spawnUsec, &loaded.bytes) != 10) {
+            continue;
+        }
+        uidstats_t *st = findUidStats(loaded.uid);
+        if (st == nullptr) {
+            LogE(DAEMON, "No room for usage stats of uid %d", loaded.uid);
+            break;
+        }
+        *st = loaded;
+    }
+    fclose(file);
+}
+
+/**
+ * Write the totals if they changed, unless they were written less than USAGE_FLUSH_SEC ago
+ * @param force write now anyway, e.g. because we are about to exit
+ */
+void flushUsageStats(bool force) {
+    if (!uidStatsDirty) {
+        return;
+    }
+    long long now = traceNow();
+    if (!force && now < usageFlushTime()) {
+        return;
+    }
+    writeUsageStats();
+    uidStatsDirty = false;
+    uidStatsWriteTime = now;
+}
+
+/**
+ * When the changed totals are due to be written, 0 if nothing changed
+ */
+long long usageFlushTime() {
+    if (!uidStatsDirty) {
+        return 0;
+    }
+    return uidStatsWriteTime + USAGE_FLUSH_SEC * 1000000LL;
+}
+
+/**
+ * Add a finished session to the totals of its uid
+ */
+void addUsage(client_t *c) {
+    uidstats_t *st = findUidStats(c->uid);
+    if (st == nullptr) {
+        LogE(DAEMON, "No room for usage stats of uid %d", c->uid);
+        return;
+    }
+    st->sessions++;
+    st->userUsec += toUsec(&c->usage.ru_utime);
+    st->sysUsec += toUsec(&c->usage.ru_stime);
+    if (c->usage.ru_maxrss > st->maxRss) {
+        st->maxRss = c->usage.ru_maxrss;
+    }
+    st->inBlock += c->usage.ru_inblock;
+    st->outBlock += c->usage.ru_oublock;
+    st->authUsec += c->authTime;
+    st->spawnUsec += c->spawnTime;
+    st->bytes += c->bytes;
+    uidStatsDirty = true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sys/resource.h>
+
+// struct definitions
+typedef struct uidstats {
+    int uid;
+    long sessions;
+    long long userUsec;
+    long long sysUsec;
+    long maxRss;
+    long inBlock;
+    long outBlock;
+    long long authUsec;
+    long long spawnUsec;
+    long long bytes;
+} uidstats_t;
+
+void formatUsage(client_t *c, char *s, size_t len);
+void addUsage(client_t *c);
+void loadUsageStats();
+void flushUsageStats(bool force);
+long long usageFlushTime();